@@ -8,25 +8,47 @@
 
 #include <iostream>
 
-color ray_color(const ray& r, const hittable& world, int depth) 
+color sky_color(const ray& r)
 {
-    hit_record rec;
+	vec3 unit_direction = unit_vector(r.direction());
+	auto t = 0.5*(unit_direction.y() + 1.0);
+	return (1.0-t)*color(1.0, 1.0, 1.0) + t*color(0.5, 0.7, 1.0);
+}
 
-    // If we've exceeded the ray bounce limit, no more light is gathered.
-    if (depth <= 0)
-        return color(0,0,0);
+// Follows the path iteratively, multiplying the attenuations into a throughput instead of
+// recursing. After rr_start_depth bounces a path survives each bounce with probability
+// max(throughput) (at most 0.95) and survivors are divided by it, which keeps the estimate
+// unbiased while dropping paths that could no longer contribute much.
+color ray_color(const ray& r_in, const hittable& world, int max_depth, int rr_start_depth)
+{
+	color throughput(1, 1, 1);
+	ray r = r_in;
+
+	for (int depth = 0; depth < max_depth; depth++)
+	{
+		hit_record rec;
+		if (!world.hit(r, 0.001, infinity, rec))
+			return throughput * sky_color(r);
 
-    if (world.hit(r, 0.001, infinity, rec)) {
 		ray scattered;
 		color attenuation;
-		if (rec.mat_ptr->scatter(r, rec, attenuation, scattered))
-			return attenuation * ray_color(scattered, world, depth - 1);
-		return color(0, 0, 0);
-    }
-
-    vec3 unit_direction = unit_vector(r.direction());
-    auto t = 0.5*(unit_direction.y() + 1.0);
-    return (1.0-t)*color(1.0, 1.0, 1.0) + t*color(0.5, 0.7, 1.0);
+		if (!rec.mat_ptr->scatter(r, rec, attenuation, scattered))
+			return color(0, 0, 0);
+
+		throughput = throughput * attenuation;
+		r = scattered;
+
+		if (depth + 1 >= rr_start_depth)
+		{
+			auto p = fmin(fmax(throughput.x(), fmax(throughput.y(), throughput.z())), 0.95);
+			if (random_double() >= p)
+				return color(0, 0, 0);
+			throughput /= p;
+		}
+	}
+
+	// If we've exceeded the ray bounce limit, no more light is gathered.
+	return color(0, 0, 0);
 }
 
 hittable_list random_scene()
@@ -91,6 +113,7 @@ int main()
 	const int image_height = static_cast<int>(image_width / aspect_ratio);
 	const int samples_per_pixel = 500;
 	const int max_depth = 50;
+	const int rr_start_depth = 3;
 
 	// World
 	//auto R = cos(pi / 4);
@@ -133,7 +156,7 @@ int main()
 				auto u = (i + random_double()) / (image_width - 1);
 				auto v = (j + random_double()) / (image_height - 1);
 				ray r = cam.get_ray(u, v);
-				pixel_color += ray_color(r, world, max_depth);
+				pixel_color += ray_color(r, world, max_depth, rr_start_depth);
 			}
 			write_color(std::cout, pixel_color, samples_per_pixel);
 		}
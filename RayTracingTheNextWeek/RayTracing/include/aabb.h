@@ -2,6 +2,7 @@
 #define AABB_H
 
 #include "rtweekend.h"
+#include "render_stats.h"
 
 class aabb
 {
@@ -12,8 +13,9 @@ public:
 	point3 min() const { return minimun; }
 	point3 max() const { return maximum; }
 
-	inline bool hit(const ray& r, double t_min, double t_max) const
+	inline bool hit(const ray& r, real t_min, real t_max) const
 	{
+		RT_STAT(box_tests++);
 		for (int i = 0; i < 3; i++)
 		{
 			auto invD = 1.0f / r.direction()[i];
@@ -29,6 +31,12 @@ public:
 		return true;
 	}
 
+	real surface_area() const
+	{
+		auto d = maximum - minimun;
+		return 2.0 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+	}
+
 	point3 minimun;
 	point3 maximum;
 };
@@ -8,11 +8,11 @@ class xy_rect : public hittable
 {
 public:
 	xy_rect() {}
-	xy_rect(double _x0, double _x1, double _y0, double _y1, double _k, shared_ptr<material>mat)
+	xy_rect(real _x0, real _x1, real _y0, real _y1, real _k, material_id mat)
 		: x0(_x0), x1(_x1), y0(_y0), y1(_y1), k(_k), mp(mat) {};
 
-	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
-	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(real time0, real time1, aabb& output_box) const override
 	{
 		// The bounding box must have non-zero width in each dimension, so pad the Z
 		// dimension a small amount.
@@ -20,21 +20,21 @@ public:
 		return true;
 	}
 public:
-	shared_ptr<material> mp;
-	double x0, x1, y0, y1, k;
+	material_id mp;
+	real x0, x1, y0, y1, k;
 };
 
 class xz_rect : public hittable {
 public:
     xz_rect() {}
 
-    xz_rect(double _x0, double _x1, double _z0, double _z1, double _k,
-        shared_ptr<material> mat)
+    xz_rect(real _x0, real _x1, real _z0, real _z1, real _k,
+        material_id mat)
         : x0(_x0), x1(_x1), z0(_z0), z1(_z1), k(_k), mp(mat) {};
 
-    virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
+    virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
 
-    virtual bool bounding_box(double time0, double time1, aabb& output_box) const override {
+    virtual bool bounding_box(real time0, real time1, aabb& output_box) const override {
         // The bounding box must have non-zero width in each dimension, so pad the Y
         // dimension a small amount.
         output_box = aabb(point3(x0, k - 0.0001, z0), point3(x1, k + 0.0001, z1));
@@ -42,21 +42,21 @@ public:
     }
 
 public:
-    shared_ptr<material> mp;
-    double x0, x1, z0, z1, k;
+    material_id mp;
+    real x0, x1, z0, z1, k;
 };
 
 class yz_rect : public hittable {
 public:
     yz_rect() {}
 
-    yz_rect(double _y0, double _y1, double _z0, double _z1, double _k,
-        shared_ptr<material> mat)
+    yz_rect(real _y0, real _y1, real _z0, real _z1, real _k,
+        material_id mat)
         : y0(_y0), y1(_y1), z0(_z0), z1(_z1), k(_k), mp(mat) {};
 
-    virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
+    virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
 
-    virtual bool bounding_box(double time0, double time1, aabb& output_box) const override {
+    virtual bool bounding_box(real time0, real time1, aabb& output_box) const override {
         // The bounding box must have non-zero width in each dimension, so pad the X
         // dimension a small amount.
         output_box = aabb(point3(k - 0.0001, y0, z0), point3(k + 0.0001, y1, z1));
@@ -64,11 +64,11 @@ public:
     }
 
 public:
-    shared_ptr<material> mp;
-    double y0, y1, z0, z1, k;
+    material_id mp;
+    real y0, y1, z0, z1, k;
 };
 
-bool xy_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) const
+bool xy_rect::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
 {
 	auto t = (k - r.origin().z()) / r.direction().z();
 	if (t < t_min || t > t_max)
@@ -82,12 +82,12 @@ bool xy_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) con
 	rec.t = t;
 	auto outward_normal = vec3(0, 0, 1);
 	rec.set_face_normal(r, outward_normal);
-	rec.mat_ptr = mp;
+	rec.mat_id = mp;
 	rec.p = r.at(t);
 	return true;
 }
 
-bool xz_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+bool xz_rect::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
     auto t = (k - r.origin().y()) / r.direction().y();
     if (t < t_min || t > t_max)
         return false;
@@ -100,12 +100,12 @@ bool xz_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) con
     rec.t = t;
     auto outward_normal = vec3(0, 1, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
+    rec.mat_id = mp;
     rec.p = r.at(t);
     return true;
 }
 
-bool yz_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+bool yz_rect::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
     auto t = (k - r.origin().x()) / r.direction().x();
     if (t < t_min || t > t_max)
         return false;
@@ -118,7 +118,7 @@ bool yz_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) con
     rec.t = t;
     auto outward_normal = vec3(1, 0, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
+    rec.mat_id = mp;
     rec.p = r.at(t);
     return true;
 }
@@ -0,0 +1,198 @@
+#ifndef ADAPTIVE_SAMPLER_H
+#define ADAPTIVE_SAMPLER_H
+
+#include "rtweekend.h"
+
+#include "framebuffer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct adaptive_settings
+{
+	real threshold = 0;		// relative error at which a pixel stops, 0 = every pixel takes samples_per_pixel
+	int min_spp = 16;		// samples every pixel takes before its error estimate is trusted
+	int max_spp = 0;		// most samples of one pixel, 0 = 4 * samples_per_pixel
+	int pass_spp = 0;		// without a threshold: most samples per pixel in one pass, 0 = no limit
+};
+
+// Per-pixel sums of the samples taken so far, plus a running mean and variance (Welford) of
+// their luminance. The render loops take a pixel from count() up to target() samples; the
+// sampler below raises the targets pass by pass.
+class sample_accumulator
+{
+public:
+	sample_accumulator(int width, int height)
+		: width(width), height(height), pixels(static_cast<size_t>(width) * height) {}
+
+	size_t size() const { return pixels.size(); }
+	int count(size_t pixel) const { return pixels[pixel].count; }
+	int target(size_t pixel) const { return pixels[pixel].target; }
+	void set_target(size_t pixel, int n) { pixels[pixel].target = n; }
+
+	void add(size_t pixel, const color& c)
+	{
+		auto& p = pixels[pixel];
+		p.sum += c;
+		p.count++;
+
+		auto y = luminance(c);
+		auto delta = y - p.mean;
+		p.mean += delta / p.count;
+		p.m2 += delta * (y - p.mean);
+	}
+
+	color mean(size_t pixel) const
+	{
+		const auto& p = pixels[pixel];
+		return p.count ? p.sum / p.count : color(0, 0, 0);
+	}
+
+	// Standard error of the mean luminance over the mean itself. A pixel whose samples all
+	// agree (a black background, say) has error 0 whatever its brightness.
+	real relative_error(size_t pixel) const
+	{
+		const auto& p = pixels[pixel];
+		if (p.count < 2 || p.m2 <= 0)
+			return 0;
+		auto variance = p.m2 / (p.count - 1);
+		return sqrt(variance / p.count) / fmax(p.mean, 1e-3);
+	}
+
+	// What is kept per pixel; checkpoints save all of it but the target.
+	struct pixel_state
+	{
+		color sum;
+		real mean = 0;
+		real m2 = 0;
+		int count = 0;
+		int target = 0;
+	};
+
+	pixel_state& state(size_t pixel) { return pixels[pixel]; }
+	const pixel_state& state(size_t pixel) const { return pixels[pixel]; }
+
+	static real luminance(const color& c)
+	{
+		return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+	}
+
+public:
+	const int width;
+	const int height;
+
+private:
+	std::vector<pixel_state> pixels;
+};
+
+// Splits a sample budget of width * height * samples_per_pixel into render passes. Without
+// a threshold every pixel is taken to samples_per_pixel, in passes of pass_spp. Otherwise the first pass gives
+// every pixel min_spp samples; each later pass gives every pixel still above the threshold
+// a quarter more (at least min_spp), up to max_spp, so what converged pixels leave of the
+// budget goes to the noisy ones. Sampling ends when no pixel is above the threshold or the
+// budget is spent.
+//
+// A pixel is judged by the largest error in its 3x3 neighbourhood. Light that only a few
+// paths find leaves many pixels with nothing but black samples after min_spp, which on
+// their own would look converged.
+class adaptive_sampler
+{
+public:
+	// Samples already in the accumulator (from a checkpoint) count against the budget.
+	adaptive_sampler(const adaptive_settings& settings, const sample_accumulator& samples, int samples_per_pixel)
+		: settings(settings), budget(0), samples_per_pixel(samples_per_pixel)
+	{
+		uint64_t spent = 0;
+		for (size_t p = 0; p < samples.size(); p++)
+			spent += samples.count(p);
+		auto total = static_cast<uint64_t>(samples.size()) * samples_per_pixel;
+		budget = total > spent ? total - spent : 0;
+
+		if (this->settings.min_spp < 1)
+			this->settings.min_spp = 1;
+		if (this->settings.max_spp <= 0)
+			this->settings.max_spp = 4 * samples_per_pixel;
+		this->settings.max_spp = std::max(this->settings.max_spp, this->settings.min_spp);
+	}
+
+	bool adaptive() const { return settings.threshold > 0; }
+	int max_spp() const { return adaptive() ? settings.max_spp : samples_per_pixel; }
+
+	// Raises the targets of the pixels to sample in the next pass. Returns how many pixels
+	// that is, 0 when sampling is finished.
+	size_t next_pass(sample_accumulator& samples)
+	{
+		std::vector<std::pair<size_t, int> > active;	// pixel, samples to add
+		for (int j = 0; j < samples.height; ++j)
+		{
+			for (int i = 0; i < samples.width; ++i)
+			{
+				auto p = static_cast<size_t>(j) * samples.width + i;
+				auto n = samples.count(p);
+				if (!adaptive())
+				{
+					if (n < samples_per_pixel)
+						active.push_back({ p, settings.pass_spp > 0 ? std::min(settings.pass_spp, samples_per_pixel - n) : samples_per_pixel - n });
+				}
+				else if (n < settings.min_spp)
+					active.push_back({ p, settings.min_spp - n });
+				else if (n < settings.max_spp && neighbourhood_error(samples, i, j) > settings.threshold)
+					active.push_back({ p, std::min(std::max(settings.min_spp, n / 4), settings.max_spp - n) });
+			}
+		}
+		passes++;
+
+		if (active.empty() || budget == 0)
+			return 0;
+
+		auto share = std::max<uint64_t>(budget / active.size(), 1);
+		size_t scheduled = 0;
+		for (const auto& a : active)
+		{
+			auto extra = std::min(std::min(static_cast<uint64_t>(a.second), share), budget);
+			if (extra == 0)
+				break;
+
+			samples.set_target(a.first, samples.count(a.first) + static_cast<int>(extra));
+			budget -= extra;
+			scheduled++;
+		}
+		return scheduled;
+	}
+
+	int pass_count() const { return passes; }
+
+	static real neighbourhood_error(const sample_accumulator& samples, int i, int j)
+	{
+		real error = 0;
+		for (int y = std::max(j - 1, 0); y <= std::min(j + 1, samples.height - 1); ++y)
+			for (int x = std::max(i - 1, 0); x <= std::min(i + 1, samples.width - 1); ++x)
+				error = fmax(error, samples.relative_error(static_cast<size_t>(y) * samples.width + x));
+		return error;
+	}
+
+	// Samples taken per pixel as a grey image, scaled so that max_spp is white.
+	framebuffer spp_image(const sample_accumulator& samples, int width, int height) const
+	{
+		framebuffer image(width, height);
+		for (int j = 0; j < height; ++j)
+		{
+			for (int i = 0; i < width; ++i)
+			{
+				auto n = static_cast<real>(samples.count(static_cast<size_t>(j) * width + i)) / max_spp();
+				image.set(i, j, color(n, n, n));
+			}
+		}
+		return image;
+	}
+
+private:
+	adaptive_settings settings;
+	uint64_t budget;		// samples not yet handed out
+	int samples_per_pixel;
+	int passes = 0;
+};
+
+#endif
\ No newline at end of file
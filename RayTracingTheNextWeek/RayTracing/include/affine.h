@@ -0,0 +1,128 @@
+#ifndef AFFINE_H
+#define AFFINE_H
+
+#include "rtweekend.h"
+
+// A 3x4 affine transform: the linear part in the first three columns and the translation in
+// the fourth. a * b applies b first.
+class affine
+{
+public:
+	affine()
+	{
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 4; j++)
+				m[i][j] = i == j ? 1 : 0;
+	}
+
+	static affine translation(const vec3& offset)
+	{
+		affine t;
+		for (int i = 0; i < 3; i++)
+			t.m[i][3] = offset[i];
+		return t;
+	}
+
+	static affine scaling(const vec3& s)
+	{
+		affine t;
+		for (int i = 0; i < 3; i++)
+			t.m[i][i] = s[i];
+		return t;
+	}
+
+	// Counterclockwise by angle degrees looking down axis towards the origin.
+	static affine rotation(const vec3& axis, real angle)
+	{
+		auto a = unit_vector(axis);
+		auto radians = degrees_to_radians(angle);
+		auto c = cos(radians);
+		auto s = sin(radians);
+		auto k = 1 - c;
+
+		affine t;
+		t.m[0][0] = c + k * a.x() * a.x();
+		t.m[0][1] = k * a.x() * a.y() - s * a.z();
+		t.m[0][2] = k * a.x() * a.z() + s * a.y();
+		t.m[1][0] = k * a.y() * a.x() + s * a.z();
+		t.m[1][1] = c + k * a.y() * a.y();
+		t.m[1][2] = k * a.y() * a.z() - s * a.x();
+		t.m[2][0] = k * a.z() * a.x() - s * a.y();
+		t.m[2][1] = k * a.z() * a.y() + s * a.x();
+		t.m[2][2] = c + k * a.z() * a.z();
+		return t;
+	}
+
+	// The same rotation as rotate_y.
+	static affine rotation_y(real angle)
+	{
+		return rotation(vec3(0, 1, 0), angle);
+	}
+
+	affine operator*(const affine& b) const
+	{
+		affine t;
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 4; j++)
+			{
+				t.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] + m[i][2] * b.m[2][j];
+				if (j == 3)
+					t.m[i][j] += m[i][3];
+			}
+		}
+		return t;
+	}
+
+	point3 point(const point3& p) const
+	{
+		return vector(p) + vec3(m[0][3], m[1][3], m[2][3]);
+	}
+
+	vec3 vector(const vec3& v) const
+	{
+		return vec3(m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+					m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+					m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z());
+	}
+
+	// The linear part transposed times v. With the inverse of a transform, this carries
+	// normals the way the transform carries points.
+	vec3 transposed_vector(const vec3& v) const
+	{
+		return vec3(m[0][0] * v.x() + m[1][0] * v.y() + m[2][0] * v.z(),
+					m[0][1] * v.x() + m[1][1] * v.y() + m[2][1] * v.z(),
+					m[0][2] * v.x() + m[1][2] * v.y() + m[2][2] * v.z());
+	}
+
+	// Undefined for a singular linear part.
+	affine inverse() const
+	{
+		affine t;
+		auto det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+				 - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+				 + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+		auto inv_det = 1 / det;
+
+		t.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * inv_det;
+		t.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+		t.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+		t.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * inv_det;
+		t.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+		t.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+		t.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * inv_det;
+		t.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+		t.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+
+		// The translation undoes the original one after the inverse linear part.
+		auto offset = t.vector(vec3(m[0][3], m[1][3], m[2][3]));
+		for (int i = 0; i < 3; i++)
+			t.m[i][3] = -offset[i];
+		return t;
+	}
+
+public:
+	real m[3][4];
+};
+
+#endif
\ No newline at end of file
@@ -2,43 +2,110 @@
 #define BOX_H
 
 #include "rtweekend.h"
-#include "aarect.h"
-#include "hittable_list.h"
+#include "hittable.h"
 
+#include <utility>
+
+// An axis-aligned box, intersected with one slab test. The face that is hit, and with it the
+// normal, is the axis whose slab the ray enters last (or leaves first, from inside). u and v
+// are the same as the matching xy_rect, xz_rect or yz_rect would report.
 class box : public hittable
 {
 public:
 	box() {}
-	box(const point3& p0, const point3& p1, shared_ptr<material> ptr);
-	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
-	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override
+	box(const point3& p0, const point3& p1, material_id ptr) : box_min(p0), box_max(p1), mp(ptr) {}
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override
+	{
+		return hit_box(box_min, box_max, mp, r, t_min, t_max, rec);
+	}
+	virtual bool bounding_box(real time0, real time1, aabb& output_box) const override
 	{
 		output_box = aabb(box_min, box_max);
 		return true;
 	}
+	virtual bool convex() const override { return true; }
+	virtual bool hit_interval(const ray& r, real& t_enter, real& t_exit) const override
+	{
+		int near_axis, far_axis;
+		return slabs(box_min, box_max, r, t_enter, t_exit, near_axis, far_axis);
+	}
+
+	static bool hit_box(const point3& box_min, const point3& box_max, material_id mat,
+						const ray& r, real t_min, real t_max, hit_record& rec);
+
+	// Where the line of r enters and leaves the box, and the axes of those two faces.
+	static bool slabs(const point3& box_min, const point3& box_max, const ray& r,
+					  real& t_near, real& t_far, int& near_axis, int& far_axis);
 public:
 	point3 box_min;
 	point3 box_max;
-	hittable_list sides;
+	material_id mp;
 };
 
-box::box(const point3& p0, const point3& p1, shared_ptr<material> ptr)
+bool box::slabs(const point3& box_min, const point3& box_max, const ray& r,
+				real& t_near, real& t_far, int& near_axis, int& far_axis)
 {
-	box_min = p0;
-	box_max = p1;
+	t_near = -infinity;
+	t_far = infinity;
+	near_axis = 0;
+	far_axis = 0;
+	for (int a = 0; a < 3; a++)
+	{
+		auto inv_d = 1 / r.direction()[a];
+		auto t0 = (box_min[a] - r.origin()[a]) * inv_d;
+		auto t1 = (box_max[a] - r.origin()[a]) * inv_d;
+		if (inv_d < 0)
+			std::swap(t0, t1);
+		if (t0 > t_near)
+		{
+			t_near = t0;
+			near_axis = a;
+		}
+		if (t1 < t_far)
+		{
+			t_far = t1;
+			far_axis = a;
+		}
+	}
+	return t_near <= t_far;
+}
 
-	sides.add(make_shared<xy_rect>(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), ptr));
-	sides.add(make_shared<xy_rect>(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), ptr));
+bool box::hit_box(const point3& box_min, const point3& box_max, material_id mat,
+				  const ray& r, real t_min, real t_max, hit_record& rec)
+{
+	real t_near, t_far;
+	int near_axis, far_axis;
+	if (!slabs(box_min, box_max, r, t_near, t_far, near_axis, far_axis))
+		return false;
 
-	sides.add(make_shared<xz_rect>(p0.x(), p1.x(), p0.z(), p1.z(), p1.y(), ptr));
-	sides.add(make_shared<xz_rect>(p0.x(), p1.x(), p0.z(), p1.z(), p0.y(), ptr));
+	// Entering through the face towards the origin, or leaving through the opposite one.
+	int axis;
+	bool entering;
+	if (t_near >= t_min && t_near <= t_max)
+	{
+		rec.t = t_near;
+		axis = near_axis;
+		entering = true;
+	}
+	else if (t_far >= t_min && t_far <= t_max)
+	{
+		rec.t = t_far;
+		axis = far_axis;
+		entering = false;
+	}
+	else
+		return false;
 
-	sides.add(make_shared<yz_rect>(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), ptr));
-	sides.add(make_shared<yz_rect>(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), ptr));
-}
+	rec.p = r.at(rec.t);
+	auto u_axis = axis == 0 ? 1 : 0;
+	auto v_axis = axis == 2 ? 1 : 2;
+	rec.u = (rec.p[u_axis] - box_min[u_axis]) / (box_max[u_axis] - box_min[u_axis]);
+	rec.v = (rec.p[v_axis] - box_min[v_axis]) / (box_max[v_axis] - box_min[v_axis]);
 
-bool box::hit(const ray& r, double t_min, double t_max, hit_record& rec) const
-{
-	return sides.hit(r, t_min, t_max, rec);
+	vec3 outward_normal(0, 0, 0);
+	outward_normal[axis] = (r.direction()[axis] < 0) == entering ? 1 : -1;
+	rec.set_face_normal(r, outward_normal);
+	rec.mat_id = mat;
+	return true;
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,183 @@
+#ifndef BOX_SET_H
+#define BOX_SET_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "aabb.h"
+#include "box.h"
+#include "bvh_builder.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Many boxes behind one hittable, the box counterpart of sphere_set: the bounds are kept as
+// structure of arrays and a ray is slab-tested against packet_width boxes per instruction.
+// The wide test runs in float with some slack and only rejects boxes the ray surely misses;
+// the survivors go through box::hit_box, so hits match those of separate boxes exactly.
+class box_set : public hittable
+{
+public:
+	static const size_t default_split_size = 8;	// one AVX or two SSE iterations
+
+	box_set() {}
+
+	void add(const point3& p0, const point3& p1, material_id m)
+	{
+		add_data({ p0, p1, m });
+	}
+
+	size_t size() const { return boxes.size(); }
+
+	// Spatially compact sets of at most max_size boxes each, cut with the same binned SAH the
+	// BVHs use.
+	std::vector<shared_ptr<hittable> > split(size_t max_size = default_split_size) const;
+
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(real time0, real time1, aabb& output_box) const override;
+
+private:
+	struct box_data
+	{
+		point3 box_min, box_max;
+		material_id material;
+	};
+
+	void add_data(const box_data& b);
+	void split(std::vector<bvh_build_prim>& prims, size_t start, size_t end, const bvh_build_options& options,
+			   std::vector<shared_ptr<hittable> >& out) const;
+
+private:
+	std::vector<box_data> boxes;
+
+	// Float copies of the bounds for the wide test, padded to a whole number of lanes.
+	std::vector<float> lower[3];
+	std::vector<float> upper[3];
+};
+
+void box_set::add_data(const box_data& b)
+{
+	auto n = boxes.size();
+	for (int a = 0; a < 3; a++)
+	{
+		lower[a].resize(n);
+		upper[a].resize(n);
+		lower[a].push_back(static_cast<float>(b.box_min[a]));
+		upper[a].push_back(static_cast<float>(b.box_max[a]));
+	}
+	boxes.push_back(b);
+
+	auto padded = (boxes.size() + packet_width - 1) / packet_width * packet_width;
+	for (int a = 0; a < 3; a++)
+	{
+		lower[a].resize(padded, 0.0f);
+		upper[a].resize(padded, 0.0f);
+	}
+}
+
+std::vector<shared_ptr<hittable> > box_set::split(size_t max_size) const
+{
+	std::vector<bvh_build_prim> prims(boxes.size());
+	for (size_t i = 0; i < boxes.size(); i++)
+	{
+		prims[i].box = aabb(boxes[i].box_min, boxes[i].box_max);
+		prims[i].centroid = 0.5 * (boxes[i].box_min + boxes[i].box_max);
+		prims[i].index = static_cast<uint32_t>(i);
+	}
+
+	bvh_build_options options;
+	options.max_leaf_size = static_cast<int>(std::max<size_t>(max_size, 1));
+
+	std::vector<shared_ptr<hittable> > out;
+	if (!prims.empty())
+		split(prims, 0, prims.size(), options, out);
+	return out;
+}
+
+void box_set::split(std::vector<bvh_build_prim>& prims, size_t start, size_t end, const bvh_build_options& options,
+					std::vector<shared_ptr<hittable> >& out) const
+{
+	if (end - start <= static_cast<size_t>(options.max_leaf_size))
+	{
+		auto set = make_shared<box_set>();
+		for (size_t i = start; i < end; i++)
+			set->add_data(boxes[prims[i].index]);
+		out.push_back(set);
+		return;
+	}
+
+	int axis;
+	auto mid = sah_split(prims, start, end, range_bounds(prims, start, end), options, axis);
+	split(prims, start, mid, options, out);
+	split(prims, mid, end, options, out);
+}
+
+bool box_set::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+	packet_float o[3];
+	packet_float inv_d[3];
+	for (int a = 0; a < 3; a++)
+	{
+		o[a] = packet_set1(static_cast<float>(r.origin()[a]));
+		inv_d[a] = packet_set1(static_cast<float>(1 / r.direction()[a]));
+	}
+	const packet_float zero = packet_set1(0.0f);
+	const packet_float slack = packet_set1(1e-5f);
+	const packet_float lane_t_min = packet_set1(static_cast<float>(t_min));
+
+	bool hit_anything = false;
+	for (size_t g = 0; g < boxes.size(); g += packet_width)
+	{
+		auto t_near = packet_set1(-infinity);
+		auto t_far = packet_set1(infinity);
+		for (int a = 0; a < 3; a++)
+		{
+			auto t0 = packet_mul(packet_sub(packet_loadu(&lower[a][g]), o[a]), inv_d[a]);
+			auto t1 = packet_mul(packet_sub(packet_loadu(&upper[a][g]), o[a]), inv_d[a]);
+			t_near = packet_max(t_near, packet_min(t0, t1));
+			t_far = packet_min(t_far, packet_max(t0, t1));
+		}
+
+		// Rounding may move either end by a few ulps, so both are widened by a relative slack.
+		auto near_slack = packet_mul(packet_max(t_near, packet_sub(zero, t_near)), slack);
+		auto far_slack = packet_mul(packet_max(t_far, packet_sub(zero, t_far)), slack);
+		auto lo = packet_sub(t_near, near_slack);
+		auto hi = packet_add(t_far, far_slack);
+		auto lane_t_max = packet_set1(static_cast<float>(t_max));
+
+		int lanes = ~packet_less_mask(hi, lo)
+				  & ~packet_less_mask(hi, lane_t_min)
+				  & ~packet_less_mask(lane_t_max, lo);
+		auto count = std::min(boxes.size() - g, static_cast<size_t>(packet_width));
+		lanes &= (1 << count) - 1;
+
+		for (int k = 0; lanes; k++, lanes >>= 1)
+		{
+			const auto& b = boxes[g + k];
+			if ((lanes & 1) && box::hit_box(b.box_min, b.box_max, b.material, r, t_min, t_max, rec))
+			{
+				hit_anything = true;
+				t_max = rec.t;
+			}
+		}
+	}
+
+	return hit_anything;
+}
+
+bool box_set::bounding_box(real time0, real time1, aabb& output_box) const
+{
+	if (boxes.empty())
+		return false;
+
+	for (size_t i = 0; i < boxes.size(); i++)
+	{
+		aabb b(boxes[i].box_min, boxes[i].box_max);
+		output_box = i ? surrounding_box(output_box, b) : b;
+	}
+	return true;
+}
+
+#endif
\ No newline at end of file
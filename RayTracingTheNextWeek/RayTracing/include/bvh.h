@@ -5,6 +5,8 @@
 
 #include "hittable.h"
 #include "hittable_list.h"
+#include "bvh_builder.h"
+#include "render_stats.h"
 
 #include <algorithm>
 
@@ -13,99 +15,99 @@ class bvh_node : public hittable
 public:
 	bvh_node();
 
-	bvh_node(const hittable_list& list, double time0, double time1)
-		: bvh_node(list.objects, 0, list.objects.size(), time0, time1){}
+	bvh_node(const hittable_list& list, real time0, real time1,
+			 const bvh_build_options& options = bvh_build_options(), bvh_build_stats* stats = nullptr)
+		: bvh_node(list.objects, 0, list.objects.size(), time0, time1, options, stats){}
 
-	bvh_node(const std::vector<shared_ptr<hittable> >& src_objects, size_t start, size_t end, double time0, double time1);
+	bvh_node(const std::vector<shared_ptr<hittable> >& src_objects, size_t start, size_t end, real time0, real time1,
+			 const bvh_build_options& options = bvh_build_options(), bvh_build_stats* stats = nullptr);
 
-	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
-	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override;
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(real time0, real time1, aabb& output_box) const override;
 
 public:
 	shared_ptr<hittable> left;
-	shared_ptr<hittable> right;
+	shared_ptr<hittable> right;		// null when left is the only child of a leaf
 	aabb box;
+
+private:
+	bvh_node(const std::vector<shared_ptr<hittable> >& src_objects, std::vector<bvh_build_prim>& prims,
+			 size_t start, size_t end, int depth, const bvh_build_options& options, bvh_build_stats& stats)
+	{
+		build(src_objects, prims, start, end, depth, options, stats);
+	}
+
+	void build(const std::vector<shared_ptr<hittable> >& src_objects, std::vector<bvh_build_prim>& prims,
+			   size_t start, size_t end, int depth, const bvh_build_options& options, bvh_build_stats& stats);
 };
 
 
-bool bvh_node::bounding_box(double time0, double time1, aabb& output_box) const
+bool bvh_node::bounding_box(real time0, real time1, aabb& output_box) const
 {
 	output_box = box;
 	return true;
 }
 
-bool bvh_node::hit(const ray& r, double t_min, double t_max, hit_record& rec) const
+bool bvh_node::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
 {
+	RT_STAT(bvh_nodes++);
 	if (!box.hit(r, t_min, t_max))
 		return false;
 
 	bool hit_left = left->hit(r, t_min, t_max, rec);
-	bool hit_right = right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
+	bool hit_right = right && right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
 
 	return hit_left || hit_right;
 }
 
-inline bool box_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b, int axis)
-{
-	aabb box_a;
-	aabb box_b;
-	if (!a->bounding_box(0, 0, box_a) || !b->bounding_box(0, 0, box_b))
-		std::cerr << "No bounding box in bvh_node constructor.\n";
-	return box_a.min().e[axis] < box_b.min().e[axis];
-}
-
-bool box_x_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b)
+bvh_node::bvh_node(const std::vector<shared_ptr<hittable> >& src_objects, size_t start, size_t end, real time0, real time1,
+				   const bvh_build_options& options, bvh_build_stats* stats)
 {
-	return box_compare(a, b, 0);
-}
+	bvh_build_timer timer;
+	bvh_build_stats local_stats;
+	auto prims = make_build_prims(src_objects, start, end, time0, time1);
 
-bool box_y_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b)
-{
-	return box_compare(a, b, 1);
-}
+	build(src_objects, prims, 0, prims.size(), 0, options, local_stats);
 
-bool box_z_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b)
-{
-	return box_compare(a, b, 2);
+	if (stats)
+	{
+		timer.finish(local_stats, box);
+		*stats = local_stats;
+	}
 }
 
-bvh_node::bvh_node(const std::vector<shared_ptr<hittable> >& src_objects, size_t start, size_t end, double time0, double time1)
+void bvh_node::build(const std::vector<shared_ptr<hittable> >& src_objects, std::vector<bvh_build_prim>& prims,
+					 size_t start, size_t end, int depth, const bvh_build_options& options, bvh_build_stats& stats)
 {
-	auto objects = src_objects;
-	int axis = random_int(0, 2);
-	auto comparator = (axis == 0) ? box_x_compare : (axis == 1) ? box_y_compare : box_z_compare;
+	box = range_bounds(prims, start, end);
 
+	int axis;
 	size_t object_span = end - start;
+	auto mid = sah_split(prims, start, end, box, options, axis);
+
+	if (mid != end)
+	{
+		left = shared_ptr<bvh_node>(new bvh_node(src_objects, prims, start, mid, depth + 1, options, stats));
+		right = shared_ptr<bvh_node>(new bvh_node(src_objects, prims, mid, end, depth + 1, options, stats));
+		stats.add_interior(box, depth, options);
+		return;
+	}
 
 	if (object_span == 1)
-		left = right = objects[start];
+		left = src_objects[prims[start].index];
 	else if (object_span == 2)
 	{
-		if (comparator(objects[start], objects[start + 1]))
-		{
-			left = objects[start];
-			right = objects[start + 1];
-		}
-		else
-		{
-			left = objects[start + 1];
-			right = objects[start];
-		}
+		left = src_objects[prims[start].index];
+		right = src_objects[prims[start + 1].index];
 	}
 	else
 	{
-		std::sort(objects.begin() + start, objects.begin() + end, comparator);
-
-		auto mid = start + object_span / 2;
-		left = make_shared<bvh_node>(objects, start, mid, time0, time1);
-		right = make_shared<bvh_node>(objects, mid, end, time0, time1);
+		auto leaf = make_shared<hittable_list>();
+		for (size_t i = start; i < end; i++)
+			leaf->add(src_objects[prims[i].index]);
+		left = leaf;
 	}
-
-	aabb box_left, box_right;
-	if (!left->bounding_box(time0, time1, box_left) || !right->bounding_box(time0, time1, box_right))
-		std::cerr << "No bounding box in bvh_node constructor.\n";
-
-	box = surrounding_box(box_left, box_right);
+	stats.add_leaf(box, object_span, depth);
 }
 
 #endif
\ No newline at end of file
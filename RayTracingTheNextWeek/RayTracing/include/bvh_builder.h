@@ -0,0 +1,221 @@
+#ifndef BVH_BUILDER_H
+#define BVH_BUILDER_H
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+#include "hittable.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Binned surface area heuristic, shared by bvh_node and linear_bvh.
+//
+// Costs are measured in primitive intersection tests: a leaf of n primitives costs n, an
+// interior node costs traversal_cost plus the expected cost of its children, where a
+// child is reached with probability area(child) / area(parent).
+
+struct bvh_build_options
+{
+	int max_leaf_size = 4;			// ranges larger than this are always split
+	double traversal_cost = 1.0;	// cost of visiting a node, relative to one primitive test
+	int bin_count = 16;				// candidate split planes per axis = bin_count - 1
+	bool devirtualize = true;		// linear_bvh: keep known primitive types by value, see primitive_store
+	bool motion = true;				// linear_bvh: interpolate node bounds over the shutter when something moves
+};
+
+struct bvh_build_stats
+{
+	double build_ms = 0;
+	double sah_cost = 0;	// expected cost of a ray through the root, see above
+	size_t node_count = 0;
+	size_t leaf_count = 0;
+	size_t prim_count = 0;
+	int max_depth = 0;
+
+	void add_interior(const aabb& box, int depth, const bvh_build_options& options)
+	{
+		node_count++;
+		sah_cost += options.traversal_cost * box.surface_area();
+		max_depth = std::max(max_depth, depth);
+	}
+
+	void add_leaf(const aabb& box, size_t count, int depth)
+	{
+		node_count++;
+		leaf_count++;
+		prim_count += count;
+		sah_cost += count * box.surface_area();
+		max_depth = std::max(max_depth, depth);
+	}
+
+	void report(std::ostream& out, const char* name) const
+	{
+		out << name << ": " << prim_count << " primitives, " << node_count << " nodes, "
+			<< leaf_count << " leaves, depth " << max_depth << ", SAH cost " << sah_cost
+			<< ", built in " << build_ms << " ms\n";
+	}
+};
+
+// Builders accumulate raw area-weighted costs; this normalises them by the root area and
+// records the elapsed time.
+class bvh_build_timer
+{
+public:
+	bvh_build_timer() : start(std::chrono::steady_clock::now()) {}
+
+	void finish(bvh_build_stats& stats, const aabb& root) const
+	{
+		auto root_area = root.surface_area();
+		stats.sah_cost = root_area > 0 ? stats.sah_cost / root_area : 0;
+		stats.build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point start;
+};
+
+struct bvh_build_prim
+{
+	aabb box;
+	point3 centroid;
+	uint32_t index;		// into the builder's source object list
+};
+
+// Bounds and centroids are computed once up front; the build only reorders this array.
+std::vector<bvh_build_prim> make_build_prims(const std::vector<shared_ptr<hittable> >& objects,
+											 size_t start, size_t end, double time0, double time1)
+{
+	std::vector<bvh_build_prim> prims(end - start);
+	for (size_t i = start; i < end; i++)
+	{
+		auto& prim = prims[i - start];
+		if (!objects[i]->bounding_box(time0, time1, prim.box))
+			std::cerr << "No bounding box in bvh constructor.\n";
+		prim.centroid = 0.5 * (prim.box.min() + prim.box.max());
+		prim.index = static_cast<uint32_t>(i);
+	}
+	return prims;
+}
+
+aabb range_bounds(const std::vector<bvh_build_prim>& prims, size_t start, size_t end)
+{
+	aabb bounds = prims[start].box;
+	for (size_t i = start + 1; i < end; i++)
+		bounds = surrounding_box(bounds, prims[i].box);
+	return bounds;
+}
+
+// Partitions prims[start, end) in place around the cheapest binned split plane and returns
+// the split position, or returns end when a single leaf is cheaper than any split.
+// split_axis receives the axis the range was split along.
+size_t sah_split(std::vector<bvh_build_prim>& prims, size_t start, size_t end, const aabb& bounds,
+				 const bvh_build_options& options, int& split_axis)
+{
+	const int max_bins = 64;
+
+	split_axis = 0;
+	auto count = end - start;
+	if (count <= 1)
+		return end;
+
+	point3 cmin = prims[start].centroid;
+	point3 cmax = prims[start].centroid;
+	for (size_t i = start + 1; i < end; i++)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			cmin[a] = fmin(cmin[a], prims[i].centroid[a]);
+			cmax[a] = fmax(cmax[a], prims[i].centroid[a]);
+		}
+	}
+
+	auto bin_count = std::max(2, std::min(options.bin_count, max_bins));
+	auto area = bounds.surface_area();
+	auto inv_area = area > 0 ? 1.0 / area : 0.0;
+
+	auto best_cost = infinity;
+	int best_axis = -1;
+	int best_bin = 0;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		auto extent = cmax[axis] - cmin[axis];
+		if (extent <= 0)
+			continue;
+
+		aabb bin_box[max_bins];
+		size_t bin_prims[max_bins] = {};
+		auto scale = bin_count / extent;
+		for (size_t i = start; i < end; i++)
+		{
+			auto b = std::min(static_cast<int>((prims[i].centroid[axis] - cmin[axis]) * scale), bin_count - 1);
+			bin_box[b] = bin_prims[b]++ ? surrounding_box(bin_box[b], prims[i].box) : prims[i].box;
+		}
+
+		// Sweep from the right to get the area and size of every right-hand side, then from
+		// the left to price each plane.
+		double right_area[max_bins];
+		size_t right_prims[max_bins];
+		aabb acc;
+		size_t n = 0;
+		for (int b = bin_count - 1; b > 0; b--)
+		{
+			if (bin_prims[b])
+				acc = n ? surrounding_box(acc, bin_box[b]) : bin_box[b];
+			n += bin_prims[b];
+			right_area[b] = n ? acc.surface_area() : 0;
+			right_prims[b] = n;
+		}
+
+		n = 0;
+		for (int b = 1; b < bin_count; b++)
+		{
+			if (bin_prims[b - 1])
+				acc = n ? surrounding_box(acc, bin_box[b - 1]) : bin_box[b - 1];
+			n += bin_prims[b - 1];
+			if (n == 0 || right_prims[b] == 0)
+				continue;
+
+			auto cost = options.traversal_cost + (n * acc.surface_area() + right_prims[b] * right_area[b]) * inv_area;
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_axis = axis;
+				best_bin = b;
+			}
+		}
+	}
+
+	auto small_enough = count <= static_cast<size_t>(std::max(1, options.max_leaf_size));
+	if (best_axis < 0)
+	{
+		// Every centroid coincides, so there is no plane to pick; only the leaf size limit
+		// can force an (arbitrary) split.
+		return small_enough ? end : start + count / 2;
+	}
+	if (small_enough && static_cast<double>(count) <= best_cost)
+		return end;
+
+	auto axis = split_axis = best_axis;
+	auto lo = cmin[axis];
+	auto scale = bin_count / (cmax[axis] - cmin[axis]);
+	auto split = prims.begin() + start;
+	split = std::partition(split, prims.begin() + end, [=](const bvh_build_prim& p) {
+		return std::min(static_cast<int>((p.centroid[axis] - lo) * scale), bin_count - 1) < best_bin;
+	});
+
+	auto mid = static_cast<size_t>(split - prims.begin());
+	if (mid == start || mid == end)
+	{
+		mid = start + count / 2;
+		std::nth_element(prims.begin() + start, prims.begin() + mid, prims.begin() + end,
+			[axis](const bvh_build_prim& a, const bvh_build_prim& b) { return a.centroid[axis] < b.centroid[axis]; });
+	}
+	return mid;
+}
+
+#endif
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define CAMERA_H
 
 #include "rtweekend.h"
+#include "sampler.h"
 
 class camera
 {
@@ -10,12 +11,12 @@ public:
 		point3 lookfrom,
 		point3 lookat,
 		vec3 vup,
-		double vfov,
-		double aspect_ratio,
-		double aperture,
-		double focus_dist,
-		double _time0 = 0,
-		double _time1 = 0
+		real vfov,
+		real aspect_ratio,
+		real aperture,
+		real focus_dist,
+		real _time0 = 0,
+		real _time1 = 0
 	) {
 		auto theta = degrees_to_radians(vfov);
 		auto h = tan(theta / 2);
@@ -37,12 +38,16 @@ public:
 		time1 = _time1;
 	}
 
-	ray get_ray(double s, double t) const
+	// Draws the point on the lens and then the time from the current sample, even for a
+	// pinhole or a closed shutter, so the dimensions after them do not depend on the camera.
+	ray get_ray(real s, real t) const
 	{
-		vec3 rd = len_radius * random_in_unit_disk();
+		auto lens = next_2d();
+		vec3 rd = len_radius * sample_in_unit_disk(lens.u, lens.v);
 		vec3 offset = u * rd.x() + v * rd.y();
+		auto time = time0 + (time1 - time0) * next_1d();
 
-		return ray(origin + offset, lower_left_corner + horizontal * s + vertical * t - origin - offset, random_double(time0, time1)); 
+		return ray(origin + offset, lower_left_corner + horizontal * s + vertical * t - origin - offset, time); 
 	}
 
 private:
@@ -51,7 +56,7 @@ private:
 	vec3 horizontal;
 	vec3 vertical;
 	vec3 u, v, w;
-	double len_radius;
-	double time0, time1;	// shutter open/close times
+	real len_radius;
+	real time0, time1;	// shutter open/close times
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,110 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "rtweekend.h"
+
+#include "adaptive_sampler.h"
+#include "render.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+// Binary snapshot of a render in progress, in the machine's byte order:
+//
+//   "RTCK", version, width, height, sizeof(real)		5 x uint32
+//   render_job, field by field: seed				uint64
+//                               the rest			int32 each
+//   per pixel, bottom row first: sum r g b, mean, m2	5 x real
+//                                count					int32
+//
+// Nothing about the random streams needs saving: sample s of a pixel always draws from the
+// stream seeded with (seed, pixel, s), so the sample count says where each pixel resumes.
+// A resumed render therefore matches one that was never interrupted, bit for bit, as long as
+// the render_job matches; main() refuses to resume one that does not. A render taken to more
+// samples keeps the sampler laid out for the counts it started with, so it continues the same
+// sequences, but it is not the render that would have had those counts from the start: a
+// stratified grid, for one, ends at the original samples_per_pixel.
+const uint32_t checkpoint_version = 2;
+
+// Writes to a temporary file first and then replaces path, so a crash while saving leaves
+// the previous checkpoint intact.
+bool save_checkpoint(const std::string& path, const sample_accumulator& samples, const render_job& job)
+{
+	auto temp = path + ".tmp";
+	{
+		std::ofstream out(temp, std::ios::binary);
+		if (!out)
+			return false;
+
+		uint32_t header[5] = { 0, checkpoint_version, static_cast<uint32_t>(samples.width),
+							   static_cast<uint32_t>(samples.height), static_cast<uint32_t>(sizeof(real)) };
+		memcpy(header, "RTCK", 4);
+		out.write(reinterpret_cast<const char*>(header), sizeof(header));
+		render_job::for_each_field(job, [&out](const auto& field) { out.write(reinterpret_cast<const char*>(&field), sizeof(field)); });
+
+		for (size_t p = 0; p < samples.size(); p++)
+		{
+			const auto& s = samples.state(p);
+			real values[5] = { s.sum.x(), s.sum.y(), s.sum.z(), s.mean, s.m2 };
+			int32_t count = s.count;
+			out.write(reinterpret_cast<const char*>(values), sizeof(values));
+			out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+		}
+		if (!out.flush())
+			return false;
+	}
+
+	std::remove(path.c_str());	// rename does not replace an existing file on Windows
+	return std::rename(temp.c_str(), path.c_str()) == 0;
+}
+
+// Fills samples, and job with the settings they were taken with, from a checkpoint of the same
+// image size and precision. Reports what is wrong to std::cerr and returns false if the file
+// does not fit.
+bool load_checkpoint(const std::string& path, sample_accumulator& samples, render_job& job)
+{
+	std::ifstream in(path, std::ios::binary);
+	uint32_t header[5];
+	if (!in.read(reinterpret_cast<char*>(header), sizeof(header)) || memcmp(header, "RTCK", 4) || header[1] != checkpoint_version)
+	{
+		std::cerr << "'" << path << "' is not a checkpoint.\n";
+		return false;
+	}
+	if (header[2] != static_cast<uint32_t>(samples.width) || header[3] != static_cast<uint32_t>(samples.height))
+	{
+		std::cerr << "Checkpoint '" << path << "' is " << header[2] << "x" << header[3] << ", the image is "
+				  << samples.width << "x" << samples.height << ".\n";
+		return false;
+	}
+	if (header[4] != sizeof(real))
+	{
+		std::cerr << "Checkpoint '" << path << "' was saved by a build with a different RT_USE_FLOAT setting.\n";
+		return false;
+	}
+	render_job::for_each_field(job, [&in](auto& field) { in.read(reinterpret_cast<char*>(&field), sizeof(field)); });
+
+	for (size_t p = 0; p < samples.size(); p++)
+	{
+		real values[5];
+		int32_t count;
+		in.read(reinterpret_cast<char*>(values), sizeof(values));
+		in.read(reinterpret_cast<char*>(&count), sizeof(count));
+
+		auto& s = samples.state(p);
+		s.sum = color(values[0], values[1], values[2]);
+		s.mean = values[3];
+		s.m2 = values[4];
+		s.count = s.target = count;
+	}
+	if (!in)
+	{
+		std::cerr << "Checkpoint '" << path << "' is truncated.\n";
+		return false;
+	}
+	return true;
+}
+
+#endif
\ No newline at end of file
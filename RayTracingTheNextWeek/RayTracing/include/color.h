@@ -5,22 +5,25 @@
 
 #include <iostream>
 
+// Gamma-correct (gamma = 2.0) a linear component and map it to [0,255].
+inline unsigned char to_byte(double linear)
+{
+	return static_cast<unsigned char>(256 * clamp(sqrt(linear), 0.0, 0.999));
+}
+
 void write_color(std::ostream& out, color pixel_color, int samples_per_pixel)
 {
 	auto r = pixel_color.x();
 	auto g = pixel_color.y();
 	auto b = pixel_color.z();
 
-	// Divide the color by the number of samples and gamma-correct for gamma=2.0.
+	// Divide the color by the number of samples.
 	auto scale = 1.0 / samples_per_pixel;
-	r = sqrt(scale * r);
-	g = sqrt(scale * g);
-	b = sqrt(scale * b);
 
-	// Write the translated [0,255] value of each color component.
-	out << static_cast<int>(256 * clamp(r, 0.0, 0.999)) << ' '
-		<< static_cast<int>(256 * clamp(g, 0.0, 0.999)) << ' '
-		<< static_cast<int>(256 * clamp(b, 0.0, 0.999)) << '\n';
+	// Write the gamma-corrected [0,255] value of each color component.
+	out << static_cast<int>(to_byte(scale * r)) << ' '
+		<< static_cast<int>(to_byte(scale * g)) << ' '
+		<< static_cast<int>(to_byte(scale * b)) << '\n';
 }
 
 #endif
\ No newline at end of file
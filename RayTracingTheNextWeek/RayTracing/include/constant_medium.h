@@ -10,34 +10,44 @@
 class constant_medium : public hittable
 {
 public:
-	constant_medium(shared_ptr<hittable> b, double d, shared_ptr<texture> a)
-		: boundary(b), neg_inv_density(-1 / d), phase_function(make_shared<isotropic>(a)) {}
+	// phase should be an isotropic material.
+	constant_medium(shared_ptr<hittable> b, real d, material_id phase)
+		: boundary(b), neg_inv_density(-1 / d), phase_function(phase), convex_boundary(b->convex()) {}
 
-	constant_medium(shared_ptr<hittable> b, double d, color c)
-		:boundary(b), neg_inv_density(-1 / d), phase_function(make_shared<isotropic>(c)) {}
-
-	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
-	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(real time0, real time1, aabb& output_box) const override
 	{
 		return boundary->bounding_box(time0, time1, output_box);
 	}
 
 public:
 	shared_ptr<hittable> boundary;
-	shared_ptr<material> phase_function;
-	double neg_inv_density;
+	material_id phase_function;
+	real neg_inv_density;
+	bool convex_boundary;	// the boundary answers hit_interval, so one query finds both ends
 };
 
-bool constant_medium::hit(const ray& r, double t_min, double t_max, hit_record& rec) const
+bool constant_medium::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
 {
 	const bool enbaleDebug = false;
 	const bool debugging = enbaleDebug && random_double() < 0.00001;
 
 	hit_record rec1, rec2;
-	if (!boundary->hit(r, -infinity, infinity, rec1))
-		return false;
-	if (!boundary->hit(r, rec1.t + 0.0001, infinity, rec2))
-		return false;
+	if (convex_boundary)
+	{
+		if (!boundary->hit_interval(r, rec1.t, rec2.t))
+			return false;
+	}
+	else
+	{
+		if (!boundary->hit(r, -infinity, infinity, rec1))
+			return false;
+		// The step past the first hit has to grow with |t|, otherwise in single precision it
+		// rounds away on large boundaries and the same intersection is found again.
+		const auto step = fmax(0.0001, 8 * std::numeric_limits<real>::epsilon() * fabs(rec1.t));
+		if (!boundary->hit(r, rec1.t + step, infinity, rec2))
+			return false;
+	}
 	if (debugging) std::cerr << "\nt_min=" << rec1.t << ", t_max=" << rec2.t << "\n";
 
 	if (rec1.t < t_min) rec1.t = t_min;
@@ -66,7 +76,7 @@ bool constant_medium::hit(const ray& r, double t_min, double t_max, hit_record&
 
 	rec.normal = vec3(1, 0, 0);
 	rec.front_face = true;
-	rec.mat_ptr = phase_function;
+	rec.mat_id = phase_function;
 
 	return true;
 }
@@ -0,0 +1,876 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "rtweekend.h"
+
+#include "adaptive_sampler.h"
+#include "material.h"
+#include "render.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <process.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Rendering one image with several processes, on one machine or several. A coordinator
+// (--coordinator ADDRESS) listens on a socket and deals the tiles of every pass out to the
+// worker processes that connect (--worker ADDRESS), which render them and send them back.
+//
+// A tile goes out with the state of its pixels (sums, variance, sample counts and targets)
+// and comes back with the samples added, so a worker needs nothing but the scene and the
+// render settings, and what it sends is exactly what a local render would have made of those
+// pixels: sample s of a pixel always draws from the same stream. The image is the same bit
+// for bit however many workers took part and whichever of them rendered which tile.
+//
+// The coordinator keeps the pixels and only takes a tile's new state from its result. A
+// worker that disconnects, crashes or (with --worker-timeout) goes quiet is dropped and its
+// unfinished tiles go to the others, so a lost worker costs the time it had spent and no
+// more. Messages are in the machine's byte order, like checkpoints; workers on other
+// machines must share it, and their build's precision.
+//
+// ADDRESS is HOST:PORT for TCP, or unix:PATH for a Unix domain socket (not on Windows).
+
+#ifdef _WIN32
+typedef SOCKET socket_handle;
+const socket_handle no_socket = INVALID_SOCKET;
+typedef int socket_length;
+#else
+typedef int socket_handle;
+const socket_handle no_socket = -1;
+typedef socklen_t socket_length;
+#endif
+
+enum class message_type : uint32_t { hello = 1, tile = 2, result = 3, done = 4, rejected = 5, accepted = 6 };
+
+const uint32_t distributed_version = 1;
+const uint32_t max_message_size = 64u << 20;
+
+// Appends values to a message in the machine's byte order.
+class wire_writer
+{
+public:
+	template <typename T>
+	void put(const T& value)
+	{
+		auto at = bytes.size();
+		bytes.resize(at + sizeof(T));
+		memcpy(&bytes[at], &value, sizeof(T));
+	}
+
+	void put(const render_job& job)
+	{
+		put(distributed_version);
+		put(static_cast<uint32_t>(sizeof(real)));
+		render_job::for_each_field(job, [this](const auto& field) { put(field); });
+	}
+
+	void put(const sample_accumulator::pixel_state& s)
+	{
+		put(s.sum.x());
+		put(s.sum.y());
+		put(s.sum.z());
+		put(s.mean);
+		put(s.m2);
+		put(static_cast<int32_t>(s.count));
+		put(static_cast<int32_t>(s.target));
+	}
+
+public:
+	std::vector<char> bytes;
+};
+
+// Reads them back; once a read runs past the end every later one fails as well.
+class wire_reader
+{
+public:
+	explicit wire_reader(const std::vector<char>& bytes) : bytes(bytes), at(0), ok(true) {}
+
+	template <typename T>
+	bool get(T& value)
+	{
+		if (!ok || bytes.size() - at < sizeof(T))
+			return ok = false;
+		memcpy(&value, &bytes[at], sizeof(T));
+		at += sizeof(T);
+		return true;
+	}
+
+	bool get(sample_accumulator::pixel_state& s)
+	{
+		real r = 0, g = 0, b = 0;
+		int32_t count = 0, target = 0;
+		if (!get(r) || !get(g) || !get(b) || !get(s.mean) || !get(s.m2) || !get(count) || !get(target))
+			return false;
+		s.sum = color(r, g, b);
+		s.count = count;
+		s.target = target;
+		return ok;
+	}
+
+	// False as well if the job was written by another protocol version or precision.
+	bool get(render_job& job)
+	{
+		uint32_t version = 0, precision = 0;
+		get(version);
+		get(precision);
+		render_job::for_each_field(job, [this](auto& field) { get(field); });
+		return ok && version == distributed_version && precision == sizeof(real);
+	}
+
+	bool good() const { return ok; }
+	bool done() const { return ok && at == bytes.size(); }
+
+private:
+	const std::vector<char>& bytes;
+	size_t at;
+	bool ok;
+};
+
+// Thin portable layer over the sockets API.
+
+inline bool start_sockets()
+{
+#ifdef _WIN32
+	static const bool started = [] {
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return started;
+#else
+	// A worker that vanishes must show up as a failed send, not end the process.
+	signal(SIGPIPE, SIG_IGN);
+	return true;
+#endif
+}
+
+inline void close_socket(socket_handle s)
+{
+#ifdef _WIN32
+	closesocket(s);
+#else
+	close(s);
+#endif
+}
+
+inline int poll_sockets(std::vector<pollfd>& fds, int timeout_ms)
+{
+#ifdef _WIN32
+	return WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), timeout_ms);
+#else
+	return poll(fds.data(), static_cast<nfds_t>(fds.size()), timeout_ms);
+#endif
+}
+
+inline bool send_bytes(socket_handle s, const char* data, size_t size)
+{
+	while (size > 0)
+	{
+		auto chunk = static_cast<int>(std::min<size_t>(size, 1 << 30));
+		auto sent = send(s, data, chunk, 0);
+		if (sent <= 0)
+			return false;
+		data += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+inline bool receive_bytes(socket_handle s, char* data, size_t size)
+{
+	while (size > 0)
+	{
+		auto chunk = static_cast<int>(std::min<size_t>(size, 1 << 30));
+		auto received = recv(s, data, chunk, 0);
+		if (received <= 0)
+			return false;
+		data += received;
+		size -= received;
+	}
+	return true;
+}
+
+// A message is its type and payload size, two uint32, and then the payload.
+bool send_message(socket_handle s, message_type type, const std::vector<char>& payload)
+{
+	std::vector<char> bytes(8 + payload.size());
+	uint32_t header[2] = { static_cast<uint32_t>(type), static_cast<uint32_t>(payload.size()) };
+	memcpy(bytes.data(), header, sizeof(header));
+	if (!payload.empty())
+		memcpy(&bytes[8], payload.data(), payload.size());
+	return send_bytes(s, bytes.data(), bytes.size());
+}
+
+bool receive_message(socket_handle s, message_type& type, std::vector<char>& payload)
+{
+	uint32_t header[2];
+	if (!receive_bytes(s, reinterpret_cast<char*>(header), sizeof(header)) || header[1] > max_message_size)
+		return false;
+	type = static_cast<message_type>(header[0]);
+	payload.resize(header[1]);
+	return header[1] == 0 || receive_bytes(s, payload.data(), payload.size());
+}
+
+// A parsed ADDRESS, ready for bind or connect.
+struct socket_address
+{
+	sockaddr_storage storage;
+	socket_length length = 0;
+	std::string unix_path;	// empty for TCP
+};
+
+// passive: an empty HOST (":5000") means every interface. Reports what is wrong to std::cerr.
+bool resolve_address(const std::string& text, bool passive, socket_address& address)
+{
+	memset(&address.storage, 0, sizeof(address.storage));
+	if (text.compare(0, 5, "unix:") == 0)
+	{
+#ifdef _WIN32
+		std::cerr << "Unix domain sockets are not supported on this platform.\n";
+		return false;
+#else
+		sockaddr_un un;
+		memset(&un, 0, sizeof(un));
+		address.unix_path = text.substr(5);
+		if (address.unix_path.empty() || address.unix_path.size() >= sizeof(un.sun_path))
+		{
+			std::cerr << "Bad socket path in '" << text << "'.\n";
+			return false;
+		}
+		un.sun_family = AF_UNIX;
+		memcpy(un.sun_path, address.unix_path.c_str(), address.unix_path.size());
+		memcpy(&address.storage, &un, sizeof(un));
+		address.length = sizeof(un);
+		return true;
+#endif
+	}
+
+	auto colon = text.rfind(':');
+	if (colon == std::string::npos)
+	{
+		std::cerr << "Address '" << text << "' is neither HOST:PORT nor unix:PATH.\n";
+		return false;
+	}
+	auto host = text.substr(0, colon);
+	auto port = text.substr(colon + 1);
+	if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+		host = host.substr(1, host.size() - 2);
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = passive ? AI_PASSIVE : 0;
+	addrinfo* found = nullptr;
+	if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found) != 0 || !found)
+	{
+		std::cerr << "Could not resolve '" << text << "'.\n";
+		return false;
+	}
+	memcpy(&address.storage, found->ai_addr, found->ai_addrlen);
+	address.length = static_cast<socket_length>(found->ai_addrlen);
+	freeaddrinfo(found);
+	return true;
+}
+
+inline socket_handle open_socket(const socket_address& address)
+{
+	auto s = socket(address.storage.ss_family, SOCK_STREAM, 0);
+	if (s == no_socket)
+		return no_socket;
+#ifndef _WIN32
+	// Local workers are forked; they must not inherit the coordinator's sockets.
+	fcntl(s, F_SETFD, FD_CLOEXEC);
+#endif
+	if (address.unix_path.empty())
+	{
+		int on = 1;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+	}
+	return s;
+}
+
+// Connects to the coordinator, retrying for a while: workers may be started first.
+socket_handle connect_to(const std::string& text)
+{
+	socket_address address;
+	if (!start_sockets() || !resolve_address(text, false, address))
+		return no_socket;
+
+	auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+	while (true)
+	{
+		auto s = open_socket(address);
+		if (s != no_socket && connect(s, reinterpret_cast<const sockaddr*>(&address.storage), address.length) == 0)
+			return s;
+		if (s != no_socket)
+			close_socket(s);
+		if (std::chrono::steady_clock::now() > give_up)
+		{
+			std::cerr << "Could not connect to the coordinator at '" << text << "'.\n";
+			return no_socket;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+	}
+}
+
+inline int64_t process_id()
+{
+#ifdef _WIN32
+	return _getpid();
+#else
+	return getpid();
+#endif
+}
+
+// The worker side: sends hello (the job, its thread count and its process id) and once
+// accepted, calls start with the coordinator's job: its sampler may have been built for other
+// sample counts (a resumed render). Then renders each tile it is sent with render(tile) and
+// sends it back, until the coordinator says it is done. False if it was rejected or the
+// connection failed or broke off.
+//
+// Tiles are rendered on pool, or on a thread of its own without one, never on the thread
+// reading the socket: the coordinator may be blocked sending the next tile while the worker
+// sends a result, and then neither would read.
+bool run_worker(const std::string& address, const render_job& job, sample_accumulator& samples, thread_pool* pool,
+				const std::function<void(const render_job&)>& start, const std::function<void(const tile&)>& render)
+{
+	auto s = connect_to(address);
+	if (s == no_socket)
+		return false;
+
+	std::unique_ptr<thread_pool> own_pool;
+	if (!pool)
+	{
+		own_pool.reset(new thread_pool(1));
+		pool = own_pool.get();
+	}
+
+	wire_writer hello;
+	hello.put(job);
+	hello.put(static_cast<int32_t>(pool->size()));
+	hello.put(process_id());
+	std::mutex send_mutex;
+	std::atomic<bool> failed(!send_message(s, message_type::hello, hello.bytes));
+
+	message_type type;
+	std::vector<char> payload;
+	bool finished = false, rejected = false;
+	while (!failed && receive_message(s, type, payload))
+	{
+		if (type == message_type::done)
+		{
+			finished = true;
+			break;
+		}
+		if (type == message_type::rejected)
+		{
+			std::cerr << "\nThe coordinator at '" << address << "' renders with other settings.\n";
+			rejected = true;
+			break;
+		}
+		if (type == message_type::accepted)
+		{
+			render_job assigned;
+			wire_reader in(payload);
+			if (!in.get(assigned) || !in.done())
+				break;
+			start(assigned);
+			continue;
+		}
+
+		uint32_t id = 0;
+		int32_t rect[4] = {};
+		wire_reader in(payload);
+		in.get(id);
+		for (auto& r : rect)
+			in.get(r);
+		tile t = { rect[0], rect[1], rect[2], rect[3] };
+		if (type != message_type::tile || !in.good() || t.x0 < 0 || t.y0 < 0 || t.x1 > samples.width || t.y1 > samples.height || t.x0 > t.x1 || t.y0 > t.y1)
+			break;
+		for (int j = t.y0; j < t.y1; ++j)
+			for (int i = t.x0; i < t.x1; ++i)
+				in.get(samples.state(static_cast<size_t>(j) * samples.width + i));
+		if (!in.done())
+			break;
+
+		auto task = [&, id, t] {
+			render(t);
+
+			wire_writer out;
+			out.put(id);
+			out.put(t.x0);
+			out.put(t.y0);
+			out.put(t.x1);
+			out.put(t.y1);
+			for (int j = t.y0; j < t.y1; ++j)
+				for (int i = t.x0; i < t.x1; ++i)
+					out.put(samples.state(static_cast<size_t>(j) * samples.width + i));
+
+			std::lock_guard<std::mutex> lock(send_mutex);
+			if (!failed && !send_message(s, message_type::result, out.bytes))
+				failed = true;
+		};
+		pool->submit(task);
+	}
+
+	pool->wait();
+	close_socket(s);
+	if (!finished && !rejected)
+		std::cerr << "\nLost the connection to the coordinator at '" << address << "'.\n";
+	return finished;
+}
+
+// The coordinator side. Workers may connect at any time; each is sent up to two tiles per
+// thread, so it never waits for the next one.
+class tile_coordinator
+{
+public:
+	// worker_timeout: seconds a worker with tiles out may stay silent, 0 = forever.
+	tile_coordinator(const render_job& job, double worker_timeout) : job(job), worker_timeout(worker_timeout) {}
+	~tile_coordinator();
+
+	tile_coordinator(const tile_coordinator&) = delete;
+	tile_coordinator& operator=(const tile_coordinator&) = delete;
+
+	bool listen(const std::string& address);
+
+	// Starts count workers on this machine, each running this program's command line with
+	// --worker in place of the coordinator's options.
+	bool spawn_local_workers(int count, int argc, char* argv[]);
+
+	// Takes every pixel of the tiles to its target. False if no worker is left to do it.
+	bool render_pass(const std::vector<tile>& tiles, sample_accumulator& samples);
+
+private:
+	struct worker_connection
+	{
+		socket_handle socket;
+		bool ready = false;			// sent a hello that matched the job
+		int capacity = 0;			// tiles it may have at once
+		int64_t pid = 0;
+		std::vector<size_t> tiles;	// sent and not yet returned
+		std::chrono::steady_clock::time_point last_heard;
+	};
+
+	void accept_worker();
+	bool handle_message(worker_connection& w, const std::vector<tile>& tiles, sample_accumulator& samples, std::vector<char>& done);
+	bool send_tile(worker_connection& w, size_t index, const tile& t, const sample_accumulator& samples);
+	void drop_worker(size_t index, const char* reason, std::deque<size_t>& pending);
+	bool local_workers_alive();
+
+	render_job job;
+	double worker_timeout;
+	socket_handle listener = no_socket;
+	std::string unix_path;				// to remove when done
+	std::string connect_address;		// for local workers
+	std::vector<worker_connection> workers;
+	std::vector<int64_t> children;		// local workers still running
+	uint32_t next_id = 0;
+};
+
+tile_coordinator::~tile_coordinator()
+{
+	std::vector<char> none;
+	for (auto& w : workers)
+	{
+		if (w.ready)
+			send_message(w.socket, message_type::done, none);
+		close_socket(w.socket);
+	}
+	if (listener != no_socket)
+		close_socket(listener);
+
+#ifndef _WIN32
+	if (!unix_path.empty())
+		unlink(unix_path.c_str());
+
+	// Workers exit once told; any that has not after a few seconds (one that never got to
+	// connect, say) is stopped.
+	auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (local_workers_alive() && std::chrono::steady_clock::now() < give_up)
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	for (auto pid : children)
+	{
+		kill(static_cast<pid_t>(pid), SIGKILL);
+		waitpid(static_cast<pid_t>(pid), nullptr, 0);
+	}
+#endif
+}
+
+bool tile_coordinator::listen(const std::string& text)
+{
+	socket_address address;
+	if (!start_sockets() || !resolve_address(text, true, address))
+		return false;
+
+#ifndef _WIN32
+	if (!address.unix_path.empty())
+		unlink(address.unix_path.c_str());	// left behind by an earlier coordinator
+#endif
+	listener = open_socket(address);
+	if (listener != no_socket && address.unix_path.empty())
+	{
+		int on = 1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof(on));
+	}
+	if (listener == no_socket || bind(listener, reinterpret_cast<const sockaddr*>(&address.storage), address.length) != 0 ||
+		::listen(listener, 64) != 0)
+	{
+		std::cerr << "Could not listen on '" << text << "'.\n";
+		return false;
+	}
+	unix_path = address.unix_path;
+
+	// Where local workers connect: the same path, or the port actually bound (PORT may be 0)
+	// on the loopback interface if the coordinator listens on every interface.
+	if (!unix_path.empty())
+		connect_address = text;
+	else
+	{
+		sockaddr_storage bound;
+		socket_length length = sizeof(bound);
+		char host[NI_MAXHOST], port[NI_MAXSERV];
+		if (getsockname(listener, reinterpret_cast<sockaddr*>(&bound), &length) != 0 ||
+			getnameinfo(reinterpret_cast<const sockaddr*>(&bound), length, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+		{
+			std::cerr << "Could not listen on '" << text << "'.\n";
+			return false;
+		}
+		std::string h = host;
+		if (h == "0.0.0.0")
+			h = "127.0.0.1";
+		else if (h == "::")
+			h = "::1";
+		connect_address = (h.find(':') != std::string::npos ? "[" + h + "]" : h) + ":" + port;
+		std::cerr << "Coordinator listening on " << connect_address << ".\n";
+	}
+	return true;
+}
+
+bool tile_coordinator::spawn_local_workers(int count, int argc, char* argv[])
+{
+#ifdef _WIN32
+	std::cerr << "--workers is not supported on this platform; start workers with --worker.\n";
+	return false;
+#else
+	std::vector<std::string> args = { argv[0] };
+	for (int a = 1; a < argc; a++)
+	{
+		if ((!strcmp(argv[a], "--coordinator") || !strcmp(argv[a], "--workers") || !strcmp(argv[a], "--worker-timeout")) && a + 1 < argc)
+			a++;
+		else
+			args.push_back(argv[a]);
+	}
+	args.push_back("--worker");
+	args.push_back(connect_address);
+
+	std::vector<char*> child_argv;
+	for (auto& arg : args)
+		child_argv.push_back(&arg[0]);
+	child_argv.push_back(nullptr);
+
+	for (int k = 0; k < count; k++)
+	{
+		auto pid = fork();
+		if (pid < 0)
+		{
+			std::cerr << "Could not start a local worker.\n";
+			return false;
+		}
+		if (pid == 0)
+		{
+#ifdef __linux__
+			execv("/proc/self/exe", child_argv.data());
+#endif
+			execvp(argv[0], child_argv.data());
+			_exit(127);
+		}
+		children.push_back(pid);
+	}
+	return true;
+#endif
+}
+
+// Reaps the local workers that have exited; true while any is still running.
+bool tile_coordinator::local_workers_alive()
+{
+#ifndef _WIN32
+	for (size_t k = 0; k < children.size();)
+	{
+		if (waitpid(static_cast<pid_t>(children[k]), nullptr, WNOHANG) != 0)
+			children.erase(children.begin() + k);
+		else
+			k++;
+	}
+#endif
+	return !children.empty();
+}
+
+void tile_coordinator::accept_worker()
+{
+	auto s = accept(listener, nullptr, nullptr);
+	if (s == no_socket)
+		return;
+#ifndef _WIN32
+	fcntl(s, F_SETFD, FD_CLOEXEC);
+#endif
+	int on = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+
+	// Messages arrive whole and workers always read, so one that stalls halfway either way is
+	// a dead worker, not a slow one.
+#ifdef _WIN32
+	DWORD timeout = 30000;
+#else
+	timeval timeout = { 30, 0 };
+#endif
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+	setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+
+	worker_connection w;
+	w.socket = s;
+	w.last_heard = std::chrono::steady_clock::now();
+	workers.push_back(w);
+}
+
+bool tile_coordinator::send_tile(worker_connection& w, size_t index, const tile& t, const sample_accumulator& samples)
+{
+	wire_writer out;
+	out.put(static_cast<uint32_t>(index));
+	out.put(t.x0);
+	out.put(t.y0);
+	out.put(t.x1);
+	out.put(t.y1);
+	for (int j = t.y0; j < t.y1; ++j)
+		for (int i = t.x0; i < t.x1; ++i)
+			out.put(samples.state(static_cast<size_t>(j) * samples.width + i));
+	if (!send_message(w.socket, message_type::tile, out.bytes))
+		return false;
+	if (w.tiles.empty())
+		w.last_heard = std::chrono::steady_clock::now();
+	w.tiles.push_back(index);
+	return true;
+}
+
+// False if the worker is to be dropped. done[i] is set when tile i comes back.
+bool tile_coordinator::handle_message(worker_connection& w, const std::vector<tile>& tiles, sample_accumulator& samples,
+									  std::vector<char>& done)
+{
+	message_type type;
+	std::vector<char> payload;
+	if (!receive_message(w.socket, type, payload))
+		return false;
+	w.last_heard = std::chrono::steady_clock::now();
+	wire_reader in(payload);
+
+	if (type == message_type::hello && !w.ready)
+	{
+		render_job theirs;
+		int32_t threads = 0;
+		bool compatible = in.get(theirs);
+		in.get(threads);
+		in.get(w.pid);
+		auto setting = compatible ? job.mismatch(theirs) : nullptr;
+		if (!in.done() || !compatible || setting)
+		{
+			std::cerr << "\nRejected a worker with a different " << (setting ? setting : "version or precision") << ".\n";
+			send_message(w.socket, message_type::rejected, std::vector<char>());
+			return false;
+		}
+
+		// The worker takes the sample counts the sampler was built for from here.
+		wire_writer accepted;
+		accepted.put(job);
+		if (!send_message(w.socket, message_type::accepted, accepted.bytes))
+			return false;
+		w.ready = true;
+		w.capacity = 2 * std::max(threads, 1);
+		return true;
+	}
+
+	uint32_t id = 0;
+	int32_t rect[4] = {};
+	in.get(id);
+	for (auto& r : rect)
+		in.get(r);
+	if (type != message_type::result || !in.good())
+		return false;
+	auto owned = std::find(w.tiles.begin(), w.tiles.end(), static_cast<size_t>(id));
+	if (owned == w.tiles.end())
+		return false;
+	const auto& t = tiles[id];
+	if (rect[0] != t.x0 || rect[1] != t.y0 || rect[2] != t.x1 || rect[3] != t.y1)
+		return false;
+
+	// Read the whole result before taking any of it, so a bad one changes nothing.
+	std::vector<sample_accumulator::pixel_state> states(static_cast<size_t>(t.x1 - t.x0) * (t.y1 - t.y0));
+	for (auto& s : states)
+		in.get(s);
+	if (!in.done())
+		return false;
+
+	auto s = states.begin();
+	for (int j = t.y0; j < t.y1; ++j)
+	{
+		for (int i = t.x0; i < t.x1; ++i, ++s)
+		{
+			auto& p = samples.state(static_cast<size_t>(j) * samples.width + i);
+			auto target = p.target;
+			p = *s;
+			p.target = target;
+		}
+	}
+	w.tiles.erase(owned);
+	done[id] = 1;
+	return true;
+}
+
+void tile_coordinator::drop_worker(size_t index, const char* reason, std::deque<size_t>& pending)
+{
+	auto& w = workers[index];
+	if (w.ready)
+	{
+		std::cerr << "\nWorker " << w.pid << " " << reason;
+		if (!w.tiles.empty())
+			std::cerr << "; sending its " << w.tiles.size() << " tiles to the others";
+		std::cerr << ".\n";
+	}
+	for (auto t = w.tiles.rbegin(); t != w.tiles.rend(); ++t)
+		pending.push_front(*t);
+	close_socket(w.socket);
+
+#ifndef _WIN32
+	// A local worker that stopped answering would hold on to its core.
+	if (std::find(children.begin(), children.end(), w.pid) != children.end())
+		kill(static_cast<pid_t>(w.pid), SIGKILL);
+#endif
+	workers.erase(workers.begin() + index);
+}
+
+bool tile_coordinator::render_pass(const std::vector<tile>& tiles, sample_accumulator& samples)
+{
+	std::deque<size_t> pending;
+	for (size_t k = 0; k < tiles.size(); k++)
+	{
+		const auto& t = tiles[k];
+		bool unfinished = false;
+		for (int j = t.y0; j < t.y1 && !unfinished; ++j)
+			for (int i = t.x0; i < t.x1 && !unfinished; ++i)
+				unfinished = samples.count(static_cast<size_t>(j) * samples.width + i) < samples.target(static_cast<size_t>(j) * samples.width + i);
+		if (unfinished)
+			pending.push_back(k);
+	}
+
+	std::vector<char> done(tiles.size(), 0);	// came back this pass
+	const auto needed = pending.size();
+	auto remaining = needed;
+	bool waiting_reported = false;
+	while (remaining > 0)
+	{
+		// Top every worker up to its capacity.
+		for (size_t k = 0; k < workers.size();)
+		{
+			auto& w = workers[k];
+			bool sent = true;
+			while (sent && w.ready && static_cast<int>(w.tiles.size()) < w.capacity && !pending.empty())
+			{
+				auto index = pending.front();
+				pending.pop_front();
+				if (done[index])
+					continue;
+				if (!(sent = send_tile(w, index, tiles[index], samples)))
+					pending.push_front(index);
+			}
+			if (sent)
+				k++;
+			else
+				drop_worker(k, "could not be reached", pending);
+		}
+
+		auto ready = std::count_if(workers.begin(), workers.end(), [](const worker_connection& w) { return w.ready; });
+		if (ready == 0)
+		{
+			if (workers.empty() && !children.empty() && !local_workers_alive())
+			{
+				std::cerr << "\nERROR: Every local worker has exited.\n";
+				return false;
+			}
+			if (!waiting_reported)
+				std::cerr << "\rWaiting for workers... " << std::flush;
+			waiting_reported = true;
+		}
+
+		std::vector<pollfd> fds(workers.size() + 1);
+		for (size_t k = 0; k < workers.size(); k++)
+		{
+			fds[k].fd = workers[k].socket;
+			fds[k].events = POLLIN;
+		}
+		fds.back().fd = listener;
+		fds.back().events = POLLIN;
+		if (poll_sockets(fds, 500) < 0)
+			continue;
+
+		for (size_t k = workers.size(); k-- > 0;)
+		{
+			if (!fds[k].revents)
+				continue;
+			if (!handle_message(workers[k], tiles, samples, done))
+				drop_worker(k, "disconnected", pending);
+		}
+
+		remaining = needed - static_cast<size_t>(std::count(done.begin(), done.end(), 1));
+
+		if (fds.back().revents & POLLIN)
+			accept_worker();
+
+		if (worker_timeout > 0)
+		{
+			auto now = std::chrono::steady_clock::now();
+			for (size_t k = workers.size(); k-- > 0;)
+			{
+				const auto& w = workers[k];
+				if (!w.tiles.empty() && std::chrono::duration<double>(now - w.last_heard).count() > worker_timeout)
+					drop_worker(k, "timed out", pending);
+			}
+		}
+
+		std::cerr << "\rTiles remaining: " << remaining << " (" << ready << " workers)   " << std::flush;
+	}
+	return true;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,42 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "rtweekend.h"
+
+#include <vector>
+
+// Linear (not gamma-corrected) RGB radiance per pixel, stored as floats. Rows are kept in
+// image order, top row first; the render loop addresses pixels the way the camera does,
+// with j counting up from the bottom row.
+class framebuffer
+{
+public:
+	framebuffer() : width(0), height(0) {}
+	framebuffer(int w, int h) : width(w), height(h), data(3 * static_cast<size_t>(w) * h, 0.0f) {}
+
+	void set(int i, int j, const color& c)
+	{
+		auto p = pixel(i, height - 1 - j);
+		p[0] = static_cast<float>(c.x());
+		p[1] = static_cast<float>(c.y());
+		p[2] = static_cast<float>(c.z());
+	}
+
+	color get(int i, int j) const
+	{
+		auto p = pixel(i, height - 1 - j);
+		return color(p[0], p[1], p[2]);
+	}
+
+	// Pixel x of image row y, counting rows from the top.
+	float* pixel(int x, int y) { return &data[3 * (static_cast<size_t>(y) * width + x)]; }
+	const float* pixel(int x, int y) const { return &data[3 * (static_cast<size_t>(y) * width + x)]; }
+	const float* row(int y) const { return pixel(0, y); }
+
+public:
+	int width;
+	int height;
+	std::vector<float> data;
+};
+
+#endif
\ No newline at end of file
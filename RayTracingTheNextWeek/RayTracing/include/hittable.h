@@ -5,16 +5,19 @@
 #include "rtweekend.h"
 #include "aabb.h"
 
-class material;
+#include <cstdint>
+
+// Index of a material in the scene's material_table.
+typedef uint32_t material_id;
 
 struct hit_record
 {
 	point3 p;
 	vec3 normal;
-	shared_ptr<material> mat_ptr;
-	double t;
-	double u;
-	double v;
+	material_id mat_id;
+	real t;
+	real u;
+	real v;
 	bool front_face;
 	inline void set_face_normal(const ray& r, const vec3& outward_normal)
 	{
@@ -26,22 +29,53 @@ struct hit_record
 class hittable
 {
 public:
-	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const = 0;
-	virtual bool bounding_box(double time0, double time1, aabb& output_box) const = 0;
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const = 0;
+	virtual bool bounding_box(real time0, real time1, aabb& output_box) const = 0;
+
+	// Boxes around the object at time0 and at time1 such that, for every time in between,
+	// the box interpolated linearly between them still holds it. Motion BVHs build on these.
+	// An object that moves linearly can return its boxes at the two times; the default
+	// returns the box over the whole interval twice, which holds anything.
+	virtual bool motion_bounds(real time0, real time1, aabb& start, aabb& end) const
+	{
+		if (!bounding_box(time0, time1, start))
+			return false;
+		end = start;
+		return true;
+	}
+
+	// Convex shapes can report in one go the interval [t_enter, t_exit] over which the whole
+	// line of r (t unbounded either way) is inside them; false if the line misses. Only
+	// meaningful where convex() is true.
+	virtual bool convex() const { return false; }
+	virtual bool hit_interval(const ray& r, real& t_enter, real& t_exit) const { return false; }
 };
 
 class translate : public hittable
 {
 public:
 	translate(shared_ptr<hittable> p, const vec3& displacement) : ptr(p), offset(displacement) {}
-	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
-	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override;
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(real time0, real time1, aabb& output_box) const override;
+	virtual bool motion_bounds(real time0, real time1, aabb& start, aabb& end) const override
+	{
+		if (!ptr->motion_bounds(time0, time1, start, end))
+			return false;
+		start = aabb(start.min() + offset, start.max() + offset);
+		end = aabb(end.min() + offset, end.max() + offset);
+		return true;
+	}
+	virtual bool convex() const override { return ptr->convex(); }
+	virtual bool hit_interval(const ray& r, real& t_enter, real& t_exit) const override
+	{
+		return ptr->hit_interval(ray(r.origin() - offset, r.direction(), r.time()), t_enter, t_exit);
+	}
 public:
 	shared_ptr<hittable> ptr;
 	vec3 offset;
 };
 
-bool translate::hit(const ray& r, double t_min, double t_max, hit_record& rec) const
+bool translate::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
 {
 	ray moved_r(r.origin() - offset, r.direction(), r.time());
 	if (!ptr->hit(moved_r, t_min, t_max, rec))
@@ -53,7 +87,7 @@ bool translate::hit(const ray& r, double t_min, double t_max, hit_record& rec) c
 	return true;
 }
 
-bool translate::bounding_box(double time0, double time1, aabb& output_box) const
+bool translate::bounding_box(real time0, real time1, aabb& output_box) const
 {
 	if (!ptr->bounding_box(time0, time1, output_box))
 		return false;
@@ -68,23 +102,31 @@ bool translate::bounding_box(double time0, double time1, aabb& output_box) const
 class rotate_y : public hittable
 {
 public:
-	rotate_y(shared_ptr<hittable> p, double angle);
-	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
-	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override
+	rotate_y(shared_ptr<hittable> p, real angle);
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(real time0, real time1, aabb& output_box) const override
 	{
 		output_box = bbox;
 		return hasbox;
 	}
+	virtual bool convex() const override { return ptr->convex(); }
+	virtual bool hit_interval(const ray& r, real& t_enter, real& t_exit) const override
+	{
+		return ptr->hit_interval(rotated(r), t_enter, t_exit);
+	}
+
+	// r in the frame of ptr. The rotation is rigid, so t means the same along both.
+	ray rotated(const ray& r) const;
 
 public:
 	shared_ptr<hittable> ptr;
-	double sin_theta;
-	double cos_theta;
+	real sin_theta;
+	real cos_theta;
 	bool hasbox;
 	aabb bbox;
 };
 
-rotate_y::rotate_y(shared_ptr<hittable> p, double angle) : ptr(p)
+rotate_y::rotate_y(shared_ptr<hittable> p, real angle) : ptr(p)
 {
 	auto radians = degrees_to_radians(angle);
 	sin_theta = sin(radians);
@@ -101,8 +143,8 @@ rotate_y::rotate_y(shared_ptr<hittable> p, double angle) : ptr(p)
 			for (int k = 0; k < 2; k++)
 			{
 				auto x = i * bbox.max().x() + (1 - i) * bbox.min().x();
-				auto y = i * bbox.max().y() + (1 - i) * bbox.min().y();
-				auto z = i * bbox.max().z() + (1 - i) * bbox.min().z();
+				auto y = j * bbox.max().y() + (1 - j) * bbox.min().y();
+				auto z = k * bbox.max().z() + (1 - k) * bbox.min().z();
 
 				auto newx =  cos_theta * x + sin_theta * z;
 				auto newz = -sin_theta * x + cos_theta * z;
@@ -120,7 +162,7 @@ rotate_y::rotate_y(shared_ptr<hittable> p, double angle) : ptr(p)
 	bbox = aabb(min, max);
 }
 
-bool rotate_y::hit(const ray& r, double t_min, double t_max, hit_record& rec) const
+ray rotate_y::rotated(const ray& r) const
 {
 	auto origin = r.origin();
 	auto direction = r.direction();
@@ -131,7 +173,12 @@ bool rotate_y::hit(const ray& r, double t_min, double t_max, hit_record& rec) co
 	direction[0] = cos_theta * r.direction()[0] - sin_theta * r.direction()[2];
 	direction[2] = sin_theta * r.direction()[0] + cos_theta * r.direction()[2];
 
-	ray roteted_r(origin, direction, r.time());
+	return ray(origin, direction, r.time());
+}
+
+bool rotate_y::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+	ray roteted_r = rotated(r);
 
 	if (!ptr->hit(roteted_r, t_min, t_max, rec))
 		return false;
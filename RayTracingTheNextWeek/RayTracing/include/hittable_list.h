@@ -19,14 +19,15 @@ public:
 	void clear() { objects.clear(); }
 	void add(shared_ptr<hittable> object) { objects.push_back(object); }
 
-	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
-	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override;
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(real time0, real time1, aabb& output_box) const override;
+	virtual bool motion_bounds(real time0, real time1, aabb& start, aabb& end) const override;
 
 public:
 	std::vector<shared_ptr<hittable>> objects;
 };
 
-bool hittable_list::hit(const ray& r, double t_min, double t_max, hit_record& rec) const
+bool hittable_list::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
 {
 	hit_record temp_rec;
 	bool hit_anything = false;
@@ -45,7 +46,7 @@ bool hittable_list::hit(const ray& r, double t_min, double t_max, hit_record& re
 	return hit_anything;
 }
 
-bool hittable_list::bounding_box(double time0, double time1, aabb& output_box) const
+bool hittable_list::bounding_box(real time0, real time1, aabb& output_box) const
 {
 	if (objects.empty()) return false;
 
@@ -60,4 +61,23 @@ bool hittable_list::bounding_box(double time0, double time1, aabb& output_box) c
 	return true;
 }
 
+bool hittable_list::motion_bounds(real time0, real time1, aabb& start, aabb& end) const
+{
+	// The lower bound of a union of linearly moving boxes is the minimum of linear
+	// functions, which never dips below the line between its ends; likewise for the upper
+	// bound. So the union of the start boxes and of the end boxes is a valid pair.
+	if (objects.empty()) return false;
+
+	aabb part_start, part_end;
+	bool first_box = true;
+	for (const auto& object : objects)
+	{
+		if (!object->motion_bounds(time0, time1, part_start, part_end)) return false;
+		start = first_box ? part_start : surrounding_box(start, part_start);
+		end = first_box ? part_end : surrounding_box(end, part_end);
+		first_box = false;
+	}
+	return true;
+}
+
 #endif
\ No newline at end of file
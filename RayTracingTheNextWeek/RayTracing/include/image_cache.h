@@ -0,0 +1,197 @@
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include "rtweekend.h"
+#include "rtw_stb_image.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// How a cached image keeps its texels. Bytes are the file's own 8 bits per channel, turned
+// into values through a 256 entry table at lookup; floats are decoded once at load and cost
+// four times the memory.
+enum class texel_storage { bytes, floats };
+
+struct image_format
+{
+	texel_storage storage = texel_storage::bytes;
+
+	// Decode the sRGB curve. Off, a byte b means b / 255, the way the textures have always
+	// read their images (the output is then gamma encoded once more).
+	bool srgb = false;
+
+	bool operator<(const image_format& other) const
+	{
+		return storage != other.storage ? storage < other.storage : srgb < other.srgb;
+	}
+};
+
+// A decoded RGB image. Texels are padded to four channels so that one texel is one 4-wide
+// load; rows are kept in file order, top row first.
+class decoded_image
+{
+public:
+	decoded_image(int w, int h, const unsigned char* rgb, image_format format);
+
+	// v counts up from the bottom row; both coordinates are clamped to [0,1].
+	color nearest(real u, real v) const;
+	color bilinear(real u, real v) const;
+
+private:
+	__m128 texel(int x, int y) const
+	{
+		auto index = 4 * (static_cast<size_t>(y) * width + x);
+		if (format.storage == texel_storage::floats)
+			return _mm_loadu_ps(&floats[index]);
+		const auto* b = &bytes[index];
+		return _mm_set_ps(0.0f, decode[b[2]], decode[b[1]], decode[b[0]]);
+	}
+
+	static color to_color(__m128 c)
+	{
+		alignas(16) float out[4];
+		_mm_store_ps(out, c);
+		return color(out[0], out[1], out[2]);
+	}
+
+public:
+	const int width;
+	const int height;
+	const image_format format;
+
+private:
+	std::vector<uint8_t> bytes;
+	std::vector<float> floats;
+	float decode[256];
+};
+
+decoded_image::decoded_image(int w, int h, const unsigned char* rgb, image_format format)
+	: width(w), height(h), format(format)
+{
+	for (int i = 0; i < 256; i++)
+	{
+		auto x = i / 255.0;
+		if (format.srgb)
+			x = x <= 0.04045 ? x / 12.92 : std::pow((x + 0.055) / 1.055, 2.4);
+		decode[i] = static_cast<float>(x);
+	}
+
+	auto texels = static_cast<size_t>(w) * h;
+	if (format.storage == texel_storage::floats)
+		floats.resize(4 * texels, 0.0f);
+	else
+		bytes.resize(4 * texels, 0);
+	for (size_t t = 0; t < texels; t++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			if (format.storage == texel_storage::floats)
+				floats[4 * t + c] = decode[rgb[3 * t + c]];
+			else
+				bytes[4 * t + c] = rgb[3 * t + c];
+		}
+	}
+}
+
+color decoded_image::nearest(real u, real v) const
+{
+	u = clamp(u, 0.0, 1.0);
+	v = 1 - clamp(v, 0.0, 1.0);	// Flip V to image coordinates
+
+	auto i = static_cast<int>(u * width);
+	auto j = static_cast<int>(v * height);
+
+	// Clamp integer mapping, since actual coordinates should be less than 1.0
+	if (i >= width)  i = width - 1;
+	if (j >= height) j = height - 1;
+
+	return to_color(texel(i, j));
+}
+
+color decoded_image::bilinear(real u, real v) const
+{
+	u = clamp(u, 0.0, 1.0);
+	v = 1 - clamp(v, 0.0, 1.0);
+
+	// Texel centres sit at half-integers; the four around the point are blended, with the
+	// edge texels repeated beyond the border.
+	auto x = u * width - 0.5;
+	auto y = v * height - 0.5;
+	auto x0 = static_cast<int>(std::floor(x));
+	auto y0 = static_cast<int>(std::floor(y));
+	auto fx = static_cast<float>(x - x0);
+	auto fy = static_cast<float>(y - y0);
+	auto x1 = std::min(x0 + 1, width - 1);
+	auto y1 = std::min(y0 + 1, height - 1);
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+
+	auto wx = _mm_set1_ps(fx);
+	auto top = _mm_add_ps(texel(x0, y0), _mm_mul_ps(wx, _mm_sub_ps(texel(x1, y0), texel(x0, y0))));
+	auto bottom = _mm_add_ps(texel(x0, y1), _mm_mul_ps(wx, _mm_sub_ps(texel(x1, y1), texel(x0, y1))));
+	return to_color(_mm_add_ps(top, _mm_mul_ps(_mm_set1_ps(fy), _mm_sub_ps(bottom, top))));
+}
+
+// A handle to a cached image; null if the file could not be loaded.
+typedef shared_ptr<const decoded_image> image_handle;
+
+// Every image the process has loaded, keyed by path and format, so that textures reading
+// the same file share one decoded copy however many objects or scenes use them. Images stay
+// until the process ends. Safe to call from several threads.
+class image_cache
+{
+public:
+	static image_cache& global()
+	{
+		static image_cache cache;
+		return cache;
+	}
+
+	image_handle load(const std::string& path, image_format format = image_format());
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return images.size();
+	}
+
+private:
+	image_cache() {}
+
+	mutable std::mutex mutex;
+	std::map<std::pair<std::string, image_format>, image_handle> images;
+};
+
+image_handle image_cache::load(const std::string& path, image_format format)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto key = std::make_pair(path, format);
+	auto found = images.find(key);
+	if (found != images.end())
+		return found->second;
+
+	// A failed load is cached as well, so the error is reported once.
+	image_handle image;
+	int width, height, components;
+	auto data = stbi_load(path.c_str(), &width, &height, &components, 3);
+	if (data)
+	{
+		image = make_shared<decoded_image>(width, height, data, format);
+		stbi_image_free(data);
+	}
+	else
+		std::cerr << "ERROR: Could not load texture image file '" << path << "'.\n";
+
+	images[key] = image;
+	return image;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,314 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "rtweekend.h"
+
+#include "color.h"
+#include "framebuffer.h"
+#include "thread_pool.h"
+#include "rtw_stb_image_write.h"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Encoders from the float framebuffer to an output stream. LDR formats are gamma-corrected
+// (gamma = 2.0) and quantised here; PFM and EXR keep the linear floats. Rows are converted
+// (and, for EXR, compressed) in parallel when a pool is given, then written in order.
+//
+// The float formats are written in the host byte order, which is little-endian on every
+// platform this builds for.
+
+class image_writer
+{
+public:
+	virtual ~image_writer() {}
+	virtual bool write(std::ostream& out, const framebuffer& fb, thread_pool* pool) const = 0;
+};
+
+template <typename F>
+void for_each_row(int height, thread_pool* pool, const F& fn)
+{
+	if (pool)
+		pool->parallel_for(0, height, fn);
+	else
+		for (int y = 0; y < height; y++)
+			fn(y);
+}
+
+// 8-bit sRGB-ish rows for the LDR writers.
+std::vector<unsigned char> quantize(const framebuffer& fb, thread_pool* pool)
+{
+	std::vector<unsigned char> bytes(3 * static_cast<size_t>(fb.width) * fb.height);
+	for_each_row(fb.height, pool, [&](int y) {
+		auto src = fb.row(y);
+		auto dst = &bytes[3 * static_cast<size_t>(y) * fb.width];
+		for (int k = 0; k < 3 * fb.width; k++)
+			dst[k] = to_byte(src[k]);
+	});
+	return bytes;
+}
+
+// Plain-text PPM, the format the renderer always used to print.
+class ppm_ascii_writer : public image_writer
+{
+public:
+	virtual bool write(std::ostream& out, const framebuffer& fb, thread_pool* pool) const override
+	{
+		std::vector<std::string> rows(fb.height);
+		for_each_row(fb.height, pool, [&](int y) {
+			std::ostringstream line;
+			auto src = fb.row(y);
+			for (int x = 0; x < fb.width; x++)
+				write_color(line, color(src[3 * x], src[3 * x + 1], src[3 * x + 2]), 1);
+			rows[y] = line.str();
+		});
+
+		out << "P3\n" << fb.width << ' ' << fb.height << "\n255\n";
+		for (const auto& row : rows)
+			out << row;
+		return static_cast<bool>(out);
+	}
+};
+
+// Binary PPM.
+class ppm_writer : public image_writer
+{
+public:
+	virtual bool write(std::ostream& out, const framebuffer& fb, thread_pool* pool) const override
+	{
+		auto bytes = quantize(fb, pool);
+		out << "P6\n" << fb.width << ' ' << fb.height << "\n255\n";
+		out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+		return static_cast<bool>(out);
+	}
+};
+
+class png_writer : public image_writer
+{
+public:
+	virtual bool write(std::ostream& out, const framebuffer& fb, thread_pool* pool) const override
+	{
+		auto bytes = quantize(fb, pool);
+		auto ok = stbi_write_png_to_func(write_to_stream, &out, fb.width, fb.height, 3, bytes.data(), 3 * fb.width);
+		return ok && out;
+	}
+
+private:
+	static void write_to_stream(void* context, void* data, int size)
+	{
+		static_cast<std::ostream*>(context)->write(static_cast<const char*>(data), size);
+	}
+};
+
+// Portable float map: linear RGB, rows stored bottom to top; a negative scale marks
+// little-endian data.
+class pfm_writer : public image_writer
+{
+public:
+	virtual bool write(std::ostream& out, const framebuffer& fb, thread_pool* pool) const override
+	{
+		out << "PF\n" << fb.width << ' ' << fb.height << "\n-1.0\n";
+		for (int y = fb.height - 1; y >= 0; y--)
+			out.write(reinterpret_cast<const char*>(fb.row(y)), 3 * sizeof(float) * fb.width);
+		return static_cast<bool>(out);
+	}
+};
+
+// Single-part scanline OpenEXR with 32-bit float B, G, R channels, one scanline per
+// chunk, either uncompressed or RLE compressed.
+class exr_writer : public image_writer
+{
+public:
+	exr_writer(bool use_rle) : rle(use_rle) {}
+
+	virtual bool write(std::ostream& out, const framebuffer& fb, thread_pool* pool) const override;
+
+public:
+	bool rle;
+
+private:
+	static void put_u8(std::string& s, uint8_t v) { s.push_back(static_cast<char>(v)); }
+	static void put_i32(std::string& s, int32_t v) { for (int k = 0; k < 4; k++) put_u8(s, static_cast<uint8_t>(static_cast<uint32_t>(v) >> (8 * k))); }
+	static void put_u64(std::string& s, uint64_t v) { for (int k = 0; k < 8; k++) put_u8(s, static_cast<uint8_t>(v >> (8 * k))); }
+	static void put_f32(std::string& s, float v) { uint32_t u; memcpy(&u, &v, 4); put_i32(s, static_cast<int32_t>(u)); }
+
+	static void put_attribute(std::string& s, const char* name, const char* type, const std::string& value)
+	{
+		s.append(name).push_back('\0');
+		s.append(type).push_back('\0');
+		put_i32(s, static_cast<int32_t>(value.size()));
+		s.append(value);
+	}
+
+	static std::string header(int width, int height, bool rle);
+	static std::string rle_compress(const std::string& raw);
+};
+
+std::string exr_writer::header(int width, int height, bool rle)
+{
+	std::string s;
+	put_i32(s, 20000630);	// magic number
+	put_i32(s, 2);			// version 2, single-part scanline
+
+	std::string channels;
+	for (auto name : { "B", "G", "R" })	// channels are listed in alphabetical order
+	{
+		channels.append(name).push_back('\0');
+		put_i32(channels, 2);	// FLOAT
+		put_i32(channels, 0);	// pLinear + reserved
+		put_i32(channels, 1);	// x sampling
+		put_i32(channels, 1);	// y sampling
+	}
+	channels.push_back('\0');
+	put_attribute(s, "channels", "chlist", channels);
+
+	put_attribute(s, "compression", "compression", std::string(1, rle ? 1 : 0));
+
+	std::string window;
+	put_i32(window, 0);
+	put_i32(window, 0);
+	put_i32(window, width - 1);
+	put_i32(window, height - 1);
+	put_attribute(s, "dataWindow", "box2i", window);
+	put_attribute(s, "displayWindow", "box2i", window);
+
+	put_attribute(s, "lineOrder", "lineOrder", std::string(1, 0));	// INCREASING_Y
+
+	std::string value;
+	put_f32(value, 1.0f);
+	put_attribute(s, "pixelAspectRatio", "float", value);
+
+	value.clear();
+	put_f32(value, 0.0f);
+	put_f32(value, 0.0f);
+	put_attribute(s, "screenWindowCenter", "v2f", value);
+
+	value.clear();
+	put_f32(value, 1.0f);
+	put_attribute(s, "screenWindowWidth", "float", value);
+
+	s.push_back('\0');
+	return s;
+}
+
+std::string exr_writer::rle_compress(const std::string& raw)
+{
+	// Same transform as OpenEXR's RLE compressor: split the even and odd bytes, delta-encode
+	// the result, then run-length encode it.
+	auto n = raw.size();
+	std::string t(n, '\0');
+	for (size_t k = 0, a = 0, b = (n + 1) / 2; k < n; k++)
+		t[k % 2 ? b++ : a++] = raw[k];
+
+	auto p = static_cast<unsigned char>(t[0]);
+	for (size_t k = 1; k < n; k++)
+	{
+		auto cur = static_cast<unsigned char>(t[k]);
+		t[k] = static_cast<char>(cur - p + (128 + 256));
+		p = cur;
+	}
+
+	const int min_run = 3;
+	const int max_run = 127;
+	std::string out;
+	size_t run_start = 0;
+	size_t run_end = 1;
+	while (run_start < n)
+	{
+		while (run_end < n && t[run_start] == t[run_end] && run_end - run_start - 1 < max_run)
+			++run_end;
+
+		if (run_end - run_start >= min_run)
+		{
+			// Repeated byte.
+			out.push_back(static_cast<char>(run_end - run_start - 1));
+			out.push_back(t[run_start]);
+			run_start = run_end;
+		}
+		else
+		{
+			// Literal bytes, up to the start of the next run of three.
+			while (run_end < n &&
+				   ((run_end + 1 >= n || t[run_end] != t[run_end + 1]) ||
+					(run_end + 2 >= n || t[run_end + 1] != t[run_end + 2])) &&
+				   run_end - run_start < max_run)
+				++run_end;
+
+			out.push_back(static_cast<char>(-static_cast<int>(run_end - run_start)));
+			out.append(t, run_start, run_end - run_start);
+			run_start = run_end;
+		}
+		++run_end;
+	}
+	return out;
+}
+
+bool exr_writer::write(std::ostream& out, const framebuffer& fb, thread_pool* pool) const
+{
+	std::vector<std::string> chunks(fb.height);
+	for_each_row(fb.height, pool, [&](int y) {
+		std::string raw;
+		raw.reserve(3 * sizeof(float) * fb.width);
+		auto src = fb.row(y);
+		for (int c = 2; c >= 0; c--)	// B, G, R
+			for (int x = 0; x < fb.width; x++)
+				raw.append(reinterpret_cast<const char*>(&src[3 * x + c]), sizeof(float));
+
+		// A chunk is stored raw whenever compression would not make it smaller.
+		if (rle)
+		{
+			auto packed = rle_compress(raw);
+			if (packed.size() < raw.size())
+				raw.swap(packed);
+		}
+
+		std::string chunk;
+		put_i32(chunk, y);
+		put_i32(chunk, static_cast<int32_t>(raw.size()));
+		chunks[y] = chunk + raw;
+	});
+
+	auto head = header(fb.width, fb.height, rle);
+	std::string offsets;
+	uint64_t offset = head.size() + 8 * static_cast<uint64_t>(fb.height);
+	for (const auto& chunk : chunks)
+	{
+		put_u64(offsets, offset);
+		offset += chunk.size();
+	}
+
+	out.write(head.data(), head.size());
+	out.write(offsets.data(), offsets.size());
+	for (const auto& chunk : chunks)
+		out.write(chunk.data(), chunk.size());
+	return static_cast<bool>(out);
+}
+
+// Format names accepted by --format; also inferred from the output file extension.
+shared_ptr<image_writer> make_image_writer(const std::string& format)
+{
+	if (format == "p3")  return make_shared<ppm_ascii_writer>();
+	if (format == "p6" || format == "ppm") return make_shared<ppm_writer>();
+	if (format == "png") return make_shared<png_writer>();
+	if (format == "pfm") return make_shared<pfm_writer>();
+	if (format == "exr") return make_shared<exr_writer>(false);
+	if (format == "exr-rle") return make_shared<exr_writer>(true);
+	return nullptr;
+}
+
+std::string format_from_filename(const std::string& filename)
+{
+	auto dot = filename.find_last_of('.');
+	if (dot == std::string::npos)
+		return "";
+	auto ext = filename.substr(dot + 1);
+	if (ext == "exr")
+		return "exr-rle";
+	return ext;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,104 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "affine.h"
+
+// A hittable placed in the world by an affine transform. The ray is carried into object
+// space with the precomputed inverse; an affine map keeps t, so the object's hit needs no
+// correction besides the point and the normal. Many instances can share one object, a
+// linear_bvh typically: a BVH over instances is then the top level of a two-level BVH and
+// each copy costs a transform, not a copy of the geometry.
+//
+// Replaces a chain of translate and rotate_y with a single hop, and allows any rotation and
+// scale. Unlike those two it keeps the object's front_face.
+class instance : public hittable
+{
+public:
+	instance(shared_ptr<hittable> p, const affine& object_to_world)
+		: object(p), object_to_world(object_to_world), world_to_object(object_to_world.inverse())
+	{
+		hasbox = object->bounding_box(0, 1, bbox) && transformed_box(bbox, bbox);
+	}
+
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(real time0, real time1, aabb& output_box) const override;
+	virtual bool motion_bounds(real time0, real time1, aabb& start, aabb& end) const override
+	{
+		// The corners of the transformed boxes move linearly as well, so this is a valid pair.
+		return object->motion_bounds(time0, time1, start, end) && transformed_box(start, start) && transformed_box(end, end);
+	}
+	virtual bool convex() const override { return object->convex(); }
+	virtual bool hit_interval(const ray& r, real& t_enter, real& t_exit) const override
+	{
+		return object->hit_interval(to_object(r), t_enter, t_exit);
+	}
+
+	ray to_object(const ray& r) const
+	{
+		return ray(world_to_object.point(r.origin()), world_to_object.vector(r.direction()), r.time());
+	}
+
+private:
+	// The world box around an object space box.
+	bool transformed_box(const aabb& object_box, aabb& output_box) const;
+
+public:
+	shared_ptr<hittable> object;
+	affine object_to_world;
+	affine world_to_object;
+
+private:
+	bool hasbox;
+	aabb bbox;	// over the shutter interval [0, 1], like rotate_y's
+};
+
+bool instance::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+	if (!object->hit(to_object(r), t_min, t_max, rec))
+		return false;
+
+	// The object's normal already faces against its ray, and the inverse transpose keeps
+	// that, so front_face stays as the object set it.
+	rec.p = r.at(rec.t);
+	rec.normal = unit_vector(world_to_object.transposed_vector(rec.normal));
+	return true;
+}
+
+bool instance::bounding_box(real time0, real time1, aabb& output_box) const
+{
+	output_box = bbox;
+	return hasbox;
+}
+
+bool instance::transformed_box(const aabb& object_box, aabb& output_box) const
+{
+	point3 min( infinity,  infinity,  infinity);
+	point3 max(-infinity, -infinity, -infinity);
+
+	for (int i = 0; i < 2; i++)
+	{
+		for (int j = 0; j < 2; j++)
+		{
+			for (int k = 0; k < 2; k++)
+			{
+				point3 corner(i ? object_box.max().x() : object_box.min().x(),
+							  j ? object_box.max().y() : object_box.min().y(),
+							  k ? object_box.max().z() : object_box.min().z());
+				auto p = object_to_world.point(corner);
+				for (int c = 0; c < 3; c++)
+				{
+					min[c] = fmin(min[c], p[c]);
+					max[c] = fmax(max[c], p[c]);
+				}
+			}
+		}
+	}
+
+	output_box = aabb(min, max);
+	return true;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,161 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "material.h"
+#include "light_list.h"
+#include "sampler.h"
+#include "render_stats.h"
+
+#include <cstring>
+
+static_assert(bounce_type_count <= max_stat_bounce_types, "render_stats counts too few bounce types");
+
+struct integrator_settings
+{
+	int max_depth = 50;			// hard cap on the number of surface/volume hits per path
+	int rr_start_depth = 3;		// bounces before Russian roulette kicks in, negative = never
+	int max_bounces[bounce_type_count] = { 50, 50, 50, 50 };	// indexed by bounce_type
+	bool sample_lights = true;	// next-event estimation, see ray_color
+
+	int& limit(bounce_type type) { return max_bounces[static_cast<int>(type)]; }
+
+	// Parses "diffuse", "glossy", "transmission" or "volume"; returns false otherwise.
+	static bool parse_bounce_type(const char* name, bounce_type& type)
+	{
+		for (int i = 0; i < bounce_type_count; i++)
+		{
+			if (!strcmp(name, bounce_type_names[i]))
+			{
+				type = static_cast<bounce_type>(i);
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+// Closest hit accepted along a ray. Scattered rays start on the surface they leave; with
+// RT_USE_FLOAT the rounding error in that start point is large enough, in a scene a few
+// hundred units across, for 0.001 to let grazing rays hit the same surface again.
+const real ray_t_min = sizeof(real) < sizeof(double) ? 0.01f : 0.001;
+
+// Iterative path tracer: radiance is accumulated along the path, weighted by the product of
+// the attenuations so far (the throughput). Once a path is rr_start_depth bounces long it
+// survives each further bounce with probability max(throughput), capped at 0.95, and the
+// survivors are reweighted by 1/p, so dim paths end early without biasing the image.
+//
+// Power heuristic (Veach) weight of a sample taken with density f, when density g would
+// have produced the same path.
+inline real power_heuristic(real f, real g)
+{
+	return f * f / (f * f + g * g);
+}
+
+// Light arriving at rec from one point picked on the lights, scattered towards r_in, and
+// weighted against the chance that mat.scatter() would have found the same light.
+color sample_direct(const ray& r_in, const hit_record& rec, const material& mat, const hittable& world,
+					const scene_assets& assets, const light_list& lights)
+{
+	light_sample light;
+	if (!lights.sample(rec.p, assets, light))
+		return color(0, 0, 0);
+
+	auto f = mat.eval(r_in, rec, light.direction, assets.textures);
+	if (f.near_zero() || light.radiance.near_zero())
+		return color(0, 0, 0);
+
+	hit_record blocker;
+	ray shadow(rec.p, light.direction, r_in.time());
+	RT_STAT(shadow_rays++);
+	if (world.hit(shadow, ray_t_min, light.distance - ray_t_min, blocker))
+		return color(0, 0, 0);
+
+	auto weight = power_heuristic(light.pdf, mat.scattering_pdf(r_in, rec, light.direction));
+	return (weight / light.pdf) * f * light.radiance;
+}
+
+// This overload continues a path whose first intersection is already known (packet tracing
+// finds it for camera rays); hit_first is false when r_in escaped.
+//
+// With settings.sample_lights, every diffuse or volume scattering point is also lit by a
+// shadow ray towards a point picked on the lights (next-event estimation). Light found that
+// way, and light a scattered ray finds by hitting an emitter, are combined with multiple
+// importance sampling, so small lights that a cosine bounce rarely hits converge quickly.
+color ray_color(const ray& r_in, bool hit_first, hit_record rec, const color& background, const hittable& world,
+				const scene_assets& assets, const light_list& lights, const integrator_settings& settings)
+{
+	color radiance(0, 0, 0);
+	color throughput(1, 1, 1);
+	int bounces[bounce_type_count] = {};
+	ray r = r_in;
+	bool sample_lights = settings.sample_lights && !lights.empty();
+	real scattering_pdf = 0;	// of the last scatter, 0 if the lights were not sampled there
+	int vertices = 0;			// surfaces and media hit, for the render_stats
+
+	for (int depth = 0; depth < settings.max_depth; depth++)
+	{
+		if (depth == 0 ? !hit_first : !world.hit(r, ray_t_min, infinity, rec))
+		{
+			radiance += throughput * background;
+			break;
+		}
+		vertices++;
+
+		const auto& mat = assets.materials[rec.mat_id];
+		auto emitted = mat.emitted(rec.u, rec.v, rec.p, assets.textures);
+		if (scattering_pdf > 0 && !emitted.near_zero())
+			emitted *= power_heuristic(scattering_pdf, lights.pdf(r, rec));
+		radiance += throughput * emitted;
+
+		ray scattered;
+		color attenuation;
+		if (!mat.scatter(r, rec, assets.textures, attenuation, scattered))
+		{
+			RT_STAT(absorbed++);
+			break;
+		}
+
+		auto type = static_cast<int>(mat.type());
+		RT_STAT(scatters[type]++);
+		if (++bounces[type] > settings.max_bounces[type])
+			break;
+
+		// The direct light belongs to the next hit, so it obeys the same depth limit.
+		scattering_pdf = 0;
+		if (sample_lights && mat.samples_lights() && depth + 1 < settings.max_depth)
+		{
+			radiance += throughput * sample_direct(r, rec, mat, world, assets, lights);
+			scattering_pdf = mat.scattering_pdf(r, rec, scattered.direction());
+		}
+
+		throughput = throughput * attenuation;
+		r = scattered;
+
+		if (settings.rr_start_depth >= 0 && depth + 1 >= settings.rr_start_depth)
+		{
+			auto p = fmin(fmax(throughput.x(), fmax(throughput.y(), throughput.z())), 0.95);
+			if (next_1d() >= p)
+				break;
+			throughput /= p;
+		}
+	}
+
+	RT_STAT(add_path(vertices));
+	return radiance;
+}
+
+color ray_color(const ray& r, const color& background, const hittable& world, const scene_assets& assets,
+				const light_list& lights, const integrator_settings& settings)
+{
+	if (settings.max_depth <= 0)
+		return color(0, 0, 0);
+
+	hit_record rec;
+	bool hit = world.hit(r, ray_t_min, infinity, rec);
+	return ray_color(r, hit, rec, background, world, assets, lights, settings);
+}
+
+#endif
\ No newline at end of file
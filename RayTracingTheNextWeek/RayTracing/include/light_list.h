@@ -0,0 +1,248 @@
+#ifndef LIGHT_LIST_H
+#define LIGHT_LIST_H
+
+#include "rtweekend.h"
+
+#include "hittable_list.h"
+#include "sphere.h"
+#include "aarect.h"
+#include "box.h"
+#include "material.h"
+#include "sampler.h"
+
+#include <typeinfo>
+#include <vector>
+
+// A point picked on a light by next-event estimation.
+struct light_sample
+{
+	vec3 direction;		// unit vector from the shaded point towards the light
+	real distance;		// to the picked point
+	color radiance;		// emitted towards the shaded point
+	real pdf;			// per solid angle at the shaded point, including the choice of light
+};
+
+// The emissive rects, boxes and static spheres of a scene, collected from the top level of
+// the world (looking into hittable_lists), for next-event estimation. Lights elsewhere,
+// under a transform or a BVH for instance, still light the scene, only through scattered
+// rays that happen to hit them.
+//
+// One light is picked uniformly per sample. A rect is sampled uniformly by area, a sphere
+// uniformly within the cone it subtends, which wastes no samples on its far side.
+class light_list
+{
+public:
+	light_list() {}
+	light_list(const hittable_list& world, const material_table& materials)
+	{
+		for (const auto& object : world.objects)
+			add(object, materials);
+	}
+
+	void add(const shared_ptr<hittable>& object, const material_table& materials);
+
+	bool empty() const { return lights.empty(); }
+	size_t size() const { return lights.size(); }
+
+	// Picks a light and a point on it as seen from origin. Returns false if the picked light
+	// cannot be seen from there at all (origin inside a sphere, say).
+	bool sample(const point3& origin, const scene_assets& assets, light_sample& s) const;
+
+	// Density with which sample() picks the direction of r, given that r's first hit is rec.
+	// 0 unless rec lies on one of the lights.
+	real pdf(const ray& r, const hit_record& rec) const;
+
+private:
+	struct area_light
+	{
+		bool is_sphere;
+		material_id mat;
+
+		// rect: the points corner + u * edge_u + v * edge_v for u, v in [0, 1], the same u, v
+		// the rect's hit() reports
+		point3 corner;
+		vec3 edge_u, edge_v;
+		vec3 normal;
+		real area;
+
+		// sphere
+		point3 center;
+		real radius;
+	};
+
+	void add_rect(const point3& corner, const vec3& edge_u, const vec3& edge_v, const vec3& normal, material_id mat);
+	static bool contains(const area_light& light, const point3& p);
+
+	// 1 - cos of the half-angle of the cone a sphere subtends from origin, or 0 from inside.
+	static real cone_size(const area_light& light, const point3& origin)
+	{
+		auto distance_squared = (light.center - origin).length_squared();
+		auto sin2 = light.radius * light.radius / distance_squared;
+		if (sin2 >= 1)
+			return 0;
+		return sin2 / (1 + sqrt(1 - sin2));	// 1 - sqrt(1 - sin2) without the cancellation
+	}
+
+private:
+	std::vector<area_light> lights;
+};
+
+void light_list::add(const shared_ptr<hittable>& object, const material_table& materials)
+{
+	const auto& type = typeid(*object);
+	if (type == typeid(hittable_list))
+	{
+		for (const auto& part : static_cast<const hittable_list&>(*object).objects)
+			add(part, materials);
+	}
+	else if (type == typeid(box))
+	{
+		const auto& b = static_cast<const box&>(*object);
+		if (materials[b.mp].emissive())
+		{
+			auto d = b.box_max - b.box_min;
+			for (int side = 0; side < 2; side++)
+			{
+				auto k = side ? b.box_max : b.box_min;
+				add_rect(point3(b.box_min.x(), b.box_min.y(), k.z()), vec3(d.x(), 0, 0), vec3(0, d.y(), 0), vec3(0, 0, 1), b.mp);
+				add_rect(point3(b.box_min.x(), k.y(), b.box_min.z()), vec3(d.x(), 0, 0), vec3(0, 0, d.z()), vec3(0, 1, 0), b.mp);
+				add_rect(point3(k.x(), b.box_min.y(), b.box_min.z()), vec3(0, d.y(), 0), vec3(0, 0, d.z()), vec3(1, 0, 0), b.mp);
+			}
+		}
+	}
+	else if (type == typeid(xy_rect))
+	{
+		const auto& r = static_cast<const xy_rect&>(*object);
+		if (materials[r.mp].emissive())
+			add_rect(point3(r.x0, r.y0, r.k), vec3(r.x1 - r.x0, 0, 0), vec3(0, r.y1 - r.y0, 0), vec3(0, 0, 1), r.mp);
+	}
+	else if (type == typeid(xz_rect))
+	{
+		const auto& r = static_cast<const xz_rect&>(*object);
+		if (materials[r.mp].emissive())
+			add_rect(point3(r.x0, r.k, r.z0), vec3(r.x1 - r.x0, 0, 0), vec3(0, 0, r.z1 - r.z0), vec3(0, 1, 0), r.mp);
+	}
+	else if (type == typeid(yz_rect))
+	{
+		const auto& r = static_cast<const yz_rect&>(*object);
+		if (materials[r.mp].emissive())
+			add_rect(point3(r.k, r.y0, r.z0), vec3(0, r.y1 - r.y0, 0), vec3(0, 0, r.z1 - r.z0), vec3(1, 0, 0), r.mp);
+	}
+	else if (type == typeid(sphere))
+	{
+		const auto& s = static_cast<const sphere&>(*object);
+		if (materials[s.mat].emissive())
+		{
+			area_light light;
+			light.is_sphere = true;
+			light.mat = s.mat;
+			light.center = s.center;
+			light.radius = fabs(s.radius);
+			lights.push_back(light);
+		}
+	}
+}
+
+void light_list::add_rect(const point3& corner, const vec3& edge_u, const vec3& edge_v, const vec3& normal, material_id mat)
+{
+	area_light light;
+	light.is_sphere = false;
+	light.mat = mat;
+	light.corner = corner;
+	light.edge_u = edge_u;
+	light.edge_v = edge_v;
+	light.normal = normal;
+	light.area = cross(edge_u, edge_v).length();
+	if (light.area > 0)
+		lights.push_back(light);
+}
+
+bool light_list::sample(const point3& origin, const scene_assets& assets, light_sample& s) const
+{
+	// Both draws come first, so an early return leaves the sample's later dimensions alone.
+	auto index = std::min(static_cast<size_t>(next_1d() * lights.size()), lights.size() - 1);
+	auto d = next_2d();
+	const auto& light = lights[index];
+
+	point3 p;
+	real u, v;
+	if (!light.is_sphere)
+	{
+		u = d.u;
+		v = d.v;
+		p = light.corner + u * light.edge_u + v * light.edge_v;
+
+		auto to_light = p - origin;
+		s.distance = to_light.length();
+		s.direction = to_light / s.distance;
+		auto cosine = fabs(dot(light.normal, s.direction));
+		if (cosine < 1e-8)
+			return false;
+		s.pdf = s.distance * s.distance / (cosine * light.area);
+	}
+	else
+	{
+		auto cone = cone_size(light, origin);
+		if (cone <= 0)
+			return false;
+
+		// A direction uniformly within the cone around w.
+		auto w = unit_vector(light.center - origin);
+		auto a = fabs(w.x()) > 0.9 ? vec3(0, 1, 0) : vec3(1, 0, 0);
+		auto t = unit_vector(cross(w, a));
+		auto b = cross(w, t);
+		auto cos_theta = 1 - d.u * cone;
+		auto sin_theta = sqrt(fmax(0.0, 1 - cos_theta * cos_theta));
+		auto phi = 2 * pi * d.v;
+		s.direction = sin_theta * cos(phi) * t + sin_theta * sin(phi) * b + cos_theta * w;
+		s.pdf = 1 / (2 * pi * cone);
+
+		// Near intersection; the discriminant is clamped for directions that graze the rim.
+		auto oc = origin - light.center;
+		auto half_b = dot(oc, s.direction);
+		auto c = oc.length_squared() - light.radius * light.radius;
+		s.distance = -half_b - sqrt(fmax(0.0, half_b * half_b - c));
+		p = origin + s.distance * s.direction;
+		sphere::get_sphere_uv((p - light.center) / light.radius, u, v);
+	}
+
+	s.radiance = assets.materials[light.mat].emitted(u, v, p, assets.textures);
+	s.pdf /= lights.size();
+	return true;
+}
+
+real light_list::pdf(const ray& r, const hit_record& rec) const
+{
+	for (const auto& light : lights)
+	{
+		if (light.mat != rec.mat_id || !contains(light, rec.p))
+			continue;
+
+		if (light.is_sphere)
+		{
+			auto cone = cone_size(light, r.origin());
+			return cone > 0 ? 1 / (2 * pi * cone * lights.size()) : 0;
+		}
+
+		auto distance = rec.t * r.direction().length();
+		auto cosine = fabs(dot(light.normal, unit_vector(r.direction())));
+		return cosine > 0 ? distance * distance / (cosine * light.area * lights.size()) : 0;
+	}
+	return 0;
+}
+
+bool light_list::contains(const area_light& light, const point3& p)
+{
+	const real tolerance = 1e-3;
+	if (light.is_sphere)
+		return fabs((p - light.center).length() - light.radius) <= tolerance * (1 + light.radius);
+
+	auto d = p - light.corner;
+	if (fabs(dot(d, light.normal)) > tolerance * (1 + light.corner.length()))
+		return false;
+	auto u = dot(d, light.edge_u) / light.edge_u.length_squared();
+	auto v = dot(d, light.edge_v) / light.edge_v.length_squared();
+	return u >= -tolerance && u <= 1 + tolerance && v >= -tolerance && v <= 1 + tolerance;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,569 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "bvh_builder.h"
+#include "ray_packet.h"
+#include "primitive_store.h"
+#include "render_stats.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// A BVH flattened into one array in depth-first order: the first child of an interior node
+// is the next node in the array, so only the second child's index is stored. Bounds are
+// floats rounded outwards, which keeps a node at 32 bytes (two per cache line).
+//
+// If any primitive moves (see hittable::motion_bounds), the node bounds are interpolated at
+// the ray's time between their boxes at time0 and time1, instead of holding everything over
+// the whole shutter. The split planes are then chosen on the boxes at mid-shutter.
+struct linear_bvh_node
+{
+	float bounds_min[3];
+	float bounds_max[3];
+	uint32_t offset;		// interior: index of the second child, leaf: first primitive
+	uint16_t prim_count;	// 0 for interior nodes
+	uint8_t axis;			// split axis of an interior node
+	uint8_t pad;
+};
+
+static_assert(sizeof(linear_bvh_node) == 32, "linear_bvh_node should be 32 bytes");
+
+// A node's bounds in a BVH over moving primitives: those at the shutter's opening (the same
+// as the node's own), and at fraction s of the way to its closing bounds + s * delta. Laid out
+// as SSE lanes x, y, z and a fourth that spans [-1, 1] and never moves, so a scalar ray tests
+// a node in one go. Kept apart from the nodes so a static BVH does not carry them.
+struct alignas(16) linear_bvh_motion
+{
+	float bounds_min[4];
+	float bounds_max[4];
+	float delta_min[4];
+	float delta_max[4];
+};
+
+static_assert(sizeof(linear_bvh_motion) == 64, "linear_bvh_motion should be one cache line");
+
+class linear_bvh : public hittable
+{
+public:
+	static const int stack_size = 64;
+
+	linear_bvh() {}
+	linear_bvh(const hittable_list& list, real time0, real time1,
+			   const bvh_build_options& options = bvh_build_options())
+		: linear_bvh(list.objects, time0, time1, options) {}
+	linear_bvh(const std::vector<shared_ptr<hittable> >& src_objects, real time0, real time1,
+			   const bvh_build_options& options = bvh_build_options());
+
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+
+	// Traces the rays of the packet whose bit is set in mask. t_max[k] is ray k's closest hit
+	// so far and shrinks as hits are found. Returns the mask of rays that hit something.
+	int hit_packet(ray_packet& packet, int mask, real t_min, real* t_max, hit_record* recs) const;
+
+	virtual bool bounding_box(real time0, real time1, aabb& output_box) const override
+	{
+		output_box = box;
+		return !nodes.empty();
+	}
+
+	// The root's boxes at the ends of the shutter the BVH was built for.
+	virtual bool motion_bounds(real time0, real time1, aabb& start, aabb& end) const override
+	{
+		if (nodes.empty())
+			return false;
+		start = node_box(0, 0);
+		end = node_box(0, 1);
+		return true;
+	}
+
+public:
+	std::vector<linear_bvh_node> nodes;
+	std::vector<linear_bvh_motion> motion;	// per node, or empty if nothing moves
+	primitive_store store;
+	std::vector<primitive_ref> primitives;	// in leaf order
+	std::vector<const linear_bvh*> nested;	// per primitive: itself if it is a linear_bvh, so packets can descend into it
+	aabb box;
+	bvh_build_stats stats;
+
+private:
+	uint32_t build(std::vector<bvh_build_prim>& prims, size_t start, size_t end, int depth,
+				   const std::vector<primitive_ref>& refs, const std::vector<aabb>& keys,
+				   const bvh_build_options& options);
+
+	template <bool Moving>
+	bool hit_nodes(const ray& r, real t_min, real t_max, hit_record& rec) const;
+
+	template <bool Moving>
+	int hit_packet_nodes(ray_packet& packet, int mask, real t_min, real* t_max, hit_record* recs) const;
+
+	// The bounds of a node at fraction s of the shutter.
+	aabb node_box(uint32_t index, real s) const
+	{
+		point3 min, max;
+		for (int a = 0; a < 3; a++)
+		{
+			min[a] = node_min(index, a, s);
+			max[a] = node_max(index, a, s);
+		}
+		return aabb(min, max);
+	}
+
+	real node_min(uint32_t index, int a, real s) const
+	{
+		real bound = nodes[index].bounds_min[a];
+		return motion.empty() ? bound : bound + s * motion[index].delta_min[a];
+	}
+
+	real node_max(uint32_t index, int a, real s) const
+	{
+		real bound = nodes[index].bounds_max[a];
+		return motion.empty() ? bound : bound + s * motion[index].delta_max[a];
+	}
+
+	// A ray set up for moving_node_hit, in float lanes laid out like linear_bvh_motion. The
+	// fourth lane has origin 0 and an infinite inverse direction, so its slab is everything.
+	struct motion_ray
+	{
+		__m128 s;			// shutter fraction, in every lane
+		__m128 origin;
+		__m128 inv_dir;
+		__m128 negative;	// all ones in the lanes whose direction is negative
+		__m128 t_min;
+	};
+
+	motion_ray make_motion_ray(const ray& r, const vec3& inv_dir, real t_min) const
+	{
+		const auto& o = r.origin();
+		auto inf = std::numeric_limits<float>::infinity();
+		motion_ray m;
+		m.s = _mm_set1_ps(static_cast<float>(shutter_fraction(r.time())));
+		m.origin = _mm_setr_ps(static_cast<float>(o.x()), static_cast<float>(o.y()), static_cast<float>(o.z()), 0.0f);
+		m.inv_dir = _mm_setr_ps(static_cast<float>(inv_dir.x()), static_cast<float>(inv_dir.y()), static_cast<float>(inv_dir.z()), inf);
+		m.negative = _mm_cmplt_ps(m.inv_dir, _mm_setzero_ps());
+		m.t_min = _mm_set1_ps(static_cast<float>(t_min));
+		return m;
+	}
+
+	// The slab test of hit_packet for one ray against an interpolated node, all three axes
+	// at once. t_max is rounded up to float, and the far distance is widened as there.
+	static bool moving_node_hit(const linear_bvh_motion& m, const motion_ray& r, __m128 t_max)
+	{
+		auto lo = _mm_add_ps(_mm_load_ps(m.bounds_min), _mm_mul_ps(r.s, _mm_load_ps(m.delta_min)));
+		auto hi = _mm_add_ps(_mm_load_ps(m.bounds_max), _mm_mul_ps(r.s, _mm_load_ps(m.delta_max)));
+
+		// Swap the planes of the axes the ray runs backwards along, so that the first one is
+		// always the near one. The NaN from 0 * inf is then dropped by min/max as in hit_packet.
+		auto swap = _mm_and_ps(_mm_xor_ps(lo, hi), r.negative);
+		auto t_near = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_xor_ps(lo, swap), r.origin), r.inv_dir), r.t_min);
+		auto t_far = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_xor_ps(hi, swap), r.origin), r.inv_dir), t_max);
+
+		t_near = _mm_max_ps(t_near, _mm_shuffle_ps(t_near, t_near, _MM_SHUFFLE(1, 0, 3, 2)));
+		t_near = _mm_max_ps(t_near, _mm_shuffle_ps(t_near, t_near, _MM_SHUFFLE(2, 3, 0, 1)));
+		t_far = _mm_min_ps(t_far, _mm_shuffle_ps(t_far, t_far, _MM_SHUFFLE(1, 0, 3, 2)));
+		t_far = _mm_min_ps(t_far, _mm_shuffle_ps(t_far, t_far, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_comilt_ss(t_near, _mm_mul_ss(t_far, _mm_set_ss(1.0000004f))) != 0;
+	}
+
+	real shutter_fraction(real time) const { return (time - shutter_open) * shutter_scale; }
+
+	static float round_down(real x)
+	{
+		auto f = static_cast<float>(x);
+		return f > x ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+	}
+
+	static float round_up(real x)
+	{
+		auto f = static_cast<float>(x);
+		return f < x ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+	}
+
+	static bool node_hit(const linear_bvh_node& node, const point3& origin, const vec3& inv_dir,
+						 real t_min, real t_max)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			auto t0 = (node.bounds_min[a] - origin[a]) * inv_dir[a];
+			auto t1 = (node.bounds_max[a] - origin[a]) * inv_dir[a];
+			if (inv_dir[a] < 0)
+				std::swap(t0, t1);
+			t_min = t0 > t_min ? t0 : t_min;
+			t_max = t1 < t_max ? t1 : t_max;
+			if (t_max <= t_min)
+				return false;
+		}
+		return true;
+	}
+
+	static bool lane_hit(const hittable& object, ray_packet& packet, int k, real t_min, real& t_max, hit_record& rec)
+	{
+		std::swap(random_generator(), packet.rng[k]);
+		bool hit = object.hit(packet.rays[k], t_min, t_max, rec);
+		std::swap(random_generator(), packet.rng[k]);
+		if (hit)
+			t_max = rec.t;
+		return hit;
+	}
+
+	bool lane_hit(primitive_ref p, ray_packet& packet, int k, real t_min, real& t_max, hit_record& rec) const
+	{
+		std::swap(random_generator(), packet.rng[k]);
+		bool hit = store.hit(p, packet.rays[k], t_min, t_max, rec);
+		std::swap(random_generator(), packet.rng[k]);
+		if (hit)
+			t_max = rec.t;
+		return hit;
+	}
+
+private:
+	real shutter_open = 0;
+	real shutter_scale = 0;		// 1 / (time1 - time0)
+};
+
+linear_bvh::linear_bvh(const std::vector<shared_ptr<hittable> >& src_objects, real time0, real time1,
+					   const bvh_build_options& options)
+{
+	if (src_objects.empty())
+		return;
+
+	bvh_build_timer timer;
+	std::vector<primitive_ref> refs;
+	for (const auto& object : src_objects)
+		store.add(object, options.devirtualize, refs);
+
+	std::vector<bvh_build_prim> prims(refs.size());
+	for (size_t i = 0; i < refs.size(); i++)
+	{
+		if (!store.bounding_box(refs[i], time0, time1, prims[i].box))
+			std::cerr << "No bounding box in bvh constructor.\n";
+		prims[i].centroid = 0.5 * (prims[i].box.min() + prims[i].box.max());
+		prims[i].index = static_cast<uint32_t>(i);
+	}
+
+	// The start and end box of every primitive, kept only if one of them moves.
+	std::vector<aabb> keys;
+	bool any_moving = false;
+	if (options.motion)
+	{
+		keys.resize(2 * refs.size());
+		for (size_t i = 0; i < refs.size(); i++)
+		{
+			auto& start = keys[2 * i];
+			auto& end = keys[2 * i + 1];
+			if (!store.motion_bounds(refs[i], time0, time1, start, end))
+				start = end = prims[i].box;
+			bool still = true;
+			for (int a = 0; a < 3; a++)
+				still = still && start.min()[a] == end.min()[a] && start.max()[a] == end.max()[a];
+			if (still)
+				continue;
+
+			any_moving = true;
+			prims[i].box = aabb(0.5 * (start.min() + end.min()), 0.5 * (start.max() + end.max()));
+			prims[i].centroid = 0.5 * (prims[i].box.min() + prims[i].box.max());
+		}
+		if (!any_moving)
+			keys.clear();
+	}
+	shutter_open = time0;
+	shutter_scale = time1 > time0 ? 1 / (time1 - time0) : 0;
+
+	nodes.reserve(2 * prims.size());
+	motion.reserve(keys.empty() ? 0 : 2 * prims.size());
+	primitives.reserve(prims.size());
+	nested.reserve(prims.size());
+	build(prims, 0, prims.size(), 0, refs, keys, options);
+
+	box = surrounding_box(node_box(0, 0), node_box(0, 1));
+	timer.finish(stats, box);
+}
+
+uint32_t linear_bvh::build(std::vector<bvh_build_prim>& prims, size_t start, size_t end, int depth,
+						   const std::vector<primitive_ref>& refs, const std::vector<aabb>& keys,
+						   const bvh_build_options& options)
+{
+	auto node_index = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+
+	auto bounds = range_bounds(prims, start, end);
+	if (keys.empty())
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			nodes[node_index].bounds_min[a] = round_down(bounds.min()[a]);
+			nodes[node_index].bounds_max[a] = round_up(bounds.max()[a]);
+		}
+	}
+	else
+	{
+		aabb key_start = keys[2 * prims[start].index];
+		aabb key_end = keys[2 * prims[start].index + 1];
+		for (size_t i = start + 1; i < end; i++)
+		{
+			key_start = surrounding_box(key_start, keys[2 * prims[i].index]);
+			key_end = surrounding_box(key_end, keys[2 * prims[i].index + 1]);
+		}
+
+		// Moving bounds are padded by a few float ulps of their size, so that rounding in
+		// the interpolation cannot cut into them.
+		motion.emplace_back();
+		auto& m = motion[node_index];
+		for (int a = 0; a < 3; a++)
+		{
+			real lo0 = key_start.min()[a], lo1 = key_end.min()[a];
+			real hi0 = key_start.max()[a], hi1 = key_end.max()[a];
+			if (lo0 != lo1 || hi0 != hi1)
+			{
+				auto pad = 4 * std::numeric_limits<float>::epsilon() * fmax(fmax(fabs(lo0), fabs(lo1)), fmax(fabs(hi0), fabs(hi1)));
+				lo0 -= pad; lo1 -= pad;
+				hi0 += pad; hi1 += pad;
+			}
+			auto& node = nodes[node_index];
+			node.bounds_min[a] = round_down(lo0);
+			node.bounds_max[a] = round_up(hi0);
+			m.bounds_min[a] = node.bounds_min[a];
+			m.bounds_max[a] = node.bounds_max[a];
+			m.delta_min[a] = round_down(lo1 - node.bounds_min[a]);
+			m.delta_max[a] = round_up(hi1 - node.bounds_max[a]);
+		}
+		m.bounds_min[3] = -1;
+		m.bounds_max[3] = 1;
+		m.delta_min[3] = m.delta_max[3] = 0;
+	}
+
+	size_t count = end - start;
+	int axis;
+	auto mid = sah_split(prims, start, end, bounds, options, axis);
+
+	// Past the traversal stack depth everything left becomes one leaf.
+	if ((mid == end || depth >= stack_size - 1) && count <= UINT16_MAX)
+	{
+		nodes[node_index].offset = static_cast<uint32_t>(primitives.size());
+		nodes[node_index].prim_count = static_cast<uint16_t>(count);
+		for (size_t i = start; i < end; i++)
+		{
+			primitives.push_back(refs[prims[i].index]);
+			nested.push_back(dynamic_cast<const linear_bvh*>(store.virtual_object(primitives.back())));
+		}
+		stats.add_leaf(bounds, count, depth);
+		return node_index;
+	}
+	if (mid == end)
+		mid = start + count / 2;
+
+	build(prims, start, mid, depth + 1, refs, keys, options);
+	auto second_child = build(prims, mid, end, depth + 1, refs, keys, options);
+
+	nodes[node_index].offset = second_child;
+	nodes[node_index].prim_count = 0;
+	nodes[node_index].axis = static_cast<uint8_t>(axis);
+	stats.add_interior(bounds, depth, options);
+	return node_index;
+}
+
+bool linear_bvh::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+	if (nodes.empty())
+		return false;
+	return motion.empty() ? hit_nodes<false>(r, t_min, t_max, rec) : hit_nodes<true>(r, t_min, t_max, rec);
+}
+
+template <bool Moving>
+bool linear_bvh::hit_nodes(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+	const auto origin = r.origin();
+	const auto direction = r.direction();
+	const vec3 inv_dir(1 / direction.x(), 1 / direction.y(), 1 / direction.z());
+	const bool dir_is_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+	motion_ray moving_ray;
+	__m128 far_limit;
+	if (Moving)
+	{
+		moving_ray = make_motion_ray(r, inv_dir, t_min);
+		far_limit = _mm_set1_ps(round_up(t_max));
+	}
+
+	uint32_t stack[stack_size];
+	int stack_ptr = 0;
+	uint32_t current = 0;
+	bool hit_anything = false;
+
+	while (true)
+	{
+		const auto& node = nodes[current];
+		RT_STAT(bvh_nodes++);
+		RT_STAT(box_tests++);
+		if (Moving ? moving_node_hit(motion[current], moving_ray, far_limit) : node_hit(node, origin, inv_dir, t_min, t_max))
+		{
+			if (node.prim_count > 0)
+			{
+				for (uint32_t i = 0; i < node.prim_count; i++)
+				{
+					if (store.hit(primitives[node.offset + i], r, t_min, t_max, rec))
+					{
+						hit_anything = true;
+						t_max = rec.t;
+						if (Moving)
+							far_limit = _mm_set1_ps(round_up(t_max));
+					}
+				}
+				if (stack_ptr == 0)
+					break;
+				current = stack[--stack_ptr];
+			}
+			else if (dir_is_neg[node.axis])
+			{
+				// Visit the child on the ray's side of the split first, so the far one is
+				// more likely to be culled by the shrunken t_max.
+				stack[stack_ptr++] = current + 1;
+				current = node.offset;
+			}
+			else
+			{
+				stack[stack_ptr++] = node.offset;
+				current = current + 1;
+			}
+		}
+		else
+		{
+			if (stack_ptr == 0)
+				break;
+			current = stack[--stack_ptr];
+		}
+	}
+
+	return hit_anything;
+}
+
+int linear_bvh::hit_packet(ray_packet& packet, int mask, real t_min, real* t_max, hit_record* recs) const
+{
+	if (nodes.empty() || mask == 0)
+		return 0;
+	return motion.empty() ? hit_packet_nodes<false>(packet, mask, t_min, t_max, recs)
+						  : hit_packet_nodes<true>(packet, mask, t_min, t_max, recs);
+}
+
+template <bool Moving>
+int linear_bvh::hit_packet_nodes(ray_packet& packet, int mask, real t_min, real* t_max, hit_record* recs) const
+{
+	int hit_mask = 0;
+	if (!packet.coherent())
+	{
+		// The rays would disagree on which child is near; trace them one at a time.
+		for (int k = 0; k < packet.count; k++)
+			if ((mask >> k) & 1 && lane_hit(*this, packet, k, t_min, t_max[k], recs[k]))
+				hit_mask |= 1 << k;
+		return hit_mask;
+	}
+
+	// Slab tests run in float on all lanes at once. Inactive lanes get an empty interval, so
+	// they never report a hit. The far distance is widened by a few ulps to cover the
+	// rounding of the origin and direction.
+	alignas(32) float origin[3][packet_width];
+	alignas(32) float inv_dir[3][packet_width];
+	alignas(32) float lane_t_max[packet_width];
+	alignas(32) float lane_s[packet_width];
+	for (int k = 0; k < packet_width; k++)
+	{
+		bool active = k < packet.count && (mask >> k) & 1;
+		for (int a = 0; a < 3; a++)
+		{
+			origin[a][k] = active ? static_cast<float>(packet.rays[k].origin()[a]) : 0.0f;
+			inv_dir[a][k] = active ? static_cast<float>(1 / packet.rays[k].direction()[a]) : 0.0f;
+		}
+		lane_t_max[k] = active ? round_up(t_max[k]) : -std::numeric_limits<float>::infinity();
+		lane_s[k] = Moving && active ? static_cast<float>(shutter_fraction(packet.rays[k].time())) : 0.0f;
+	}
+
+	const packet_float o[3] = { packet_load(origin[0]), packet_load(origin[1]), packet_load(origin[2]) };
+	const packet_float id[3] = { packet_load(inv_dir[0]), packet_load(inv_dir[1]), packet_load(inv_dir[2]) };
+	const packet_float lane_t_min = packet_set1(static_cast<float>(t_min));
+	const packet_float widen = packet_set1(1.0000004f);
+	const packet_float s = packet_load(lane_s);
+	packet_float far_limit = packet_load(lane_t_max);
+
+	const auto& first = packet.rays[0].direction();
+	const bool dir_is_neg[3] = { first.x() < 0, first.y() < 0, first.z() < 0 };
+
+	uint32_t stack[stack_size];
+	int stack_ptr = 0;
+	uint32_t current = 0;
+
+	while (true)
+	{
+		const auto& node = nodes[current];
+		RT_STAT(bvh_nodes++);
+		RT_STAT(box_tests++);
+
+		// The NaN from 0 * inf (an origin on a slab of an axis the ray is parallel to) is
+		// dropped by passing the new value as the first operand of min/max.
+		packet_float t_near = lane_t_min;
+		packet_float t_far = far_limit;
+		for (int a = 0; a < 3; a++)
+		{
+			auto lo = packet_set1(dir_is_neg[a] ? node.bounds_max[a] : node.bounds_min[a]);
+			auto hi = packet_set1(dir_is_neg[a] ? node.bounds_min[a] : node.bounds_max[a]);
+			if (Moving)
+			{
+				const auto& m = motion[current];
+				lo = packet_add(lo, packet_mul(s, packet_set1(dir_is_neg[a] ? m.delta_max[a] : m.delta_min[a])));
+				hi = packet_add(hi, packet_mul(s, packet_set1(dir_is_neg[a] ? m.delta_min[a] : m.delta_max[a])));
+			}
+			t_near = packet_max(packet_mul(packet_sub(lo, o[a]), id[a]), t_near);
+			t_far = packet_min(packet_mul(packet_sub(hi, o[a]), id[a]), t_far);
+		}
+		int lanes = packet_less_mask(t_near, packet_mul(t_far, widen));
+
+		if (lanes)
+		{
+			if (node.prim_count > 0)
+			{
+				for (uint32_t i = 0; i < node.prim_count; i++)
+				{
+					auto index = node.offset + i;
+					if (nested[index])
+					{
+						hit_mask |= nested[index]->hit_packet(packet, lanes, t_min, t_max, recs);
+						continue;
+					}
+					for (int k = 0; k < packet.count; k++)
+						if ((lanes >> k) & 1 && lane_hit(primitives[index], packet, k, t_min, t_max[k], recs[k]))
+							hit_mask |= 1 << k;
+				}
+				for (int k = 0; k < packet.count; k++)
+					if ((lanes >> k) & 1)
+						lane_t_max[k] = round_up(t_max[k]);
+				far_limit = packet_load(lane_t_max);
+
+				if (stack_ptr == 0)
+					break;
+				current = stack[--stack_ptr];
+			}
+			else if (dir_is_neg[node.axis])
+			{
+				stack[stack_ptr++] = current + 1;
+				current = node.offset;
+			}
+			else
+			{
+				stack[stack_ptr++] = node.offset;
+				current = current + 1;
+			}
+		}
+		else
+		{
+			if (stack_ptr == 0)
+				break;
+			current = stack[--stack_ptr];
+		}
+	}
+
+	return hit_mask;
+}
+
+#endif
\ No newline at end of file
@@ -2,76 +2,119 @@
 #define MATERIAL_H
 
 #include "rtweekend.h"
+#include "hittable.h"
 #include "texture.h"
+#include "sampler.h"
 
-struct hit_record;
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Which per-type bounce budget of the integrator a scatter event is charged to.
+enum class bounce_type { diffuse, glossy, transmission, volume };
+const int bounce_type_count = 4;
+const char* const bounce_type_names[bounce_type_count] = { "diffuse", "glossy", "transmission", "volume" };
 
 class material
 {
 public:
-	virtual bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const = 0;
-	virtual color emitted(double u, double v, const point3& p) const
+	virtual ~material() {}
+	virtual bool scatter(const ray& r_in, const hit_record& rec, const texture_table& textures, color& attenuation, ray& scattered) const = 0;
+	virtual color emitted(real u, real v, const point3& p, const texture_table& textures) const
+	{
+		return color(0, 0, 0);
+	}
+	virtual bounce_type type() const { return bounce_type::diffuse; }
+
+	// Next-event estimation. A material that returns true from samples_lights() is lit by
+	// shadow rays towards the scene's lights as well as by its own scattered rays: eval() is
+	// the scattered radiance per unit radiance arriving from direction (BSDF times cosine),
+	// and scattering_pdf() the density, per solid angle, of scatter() picking it. Mirrors and
+	// glass leave them alone and are only lit through scatter().
+	virtual bool samples_lights() const { return false; }
+	virtual color eval(const ray& r_in, const hit_record& rec, const vec3& direction, const texture_table& textures) const
 	{
 		return color(0, 0, 0);
 	}
+	virtual real scattering_pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const
+	{
+		return 0;
+	}
+
+	virtual bool emissive() const { return false; }
 };
 
 class lambertian : public material
 {
 public:
-	lambertian(const color& a) : albedo(make_shared<solid_color>(a)) {}
-	lambertian(shared_ptr<texture> a) : albedo(a) {}
-	virtual bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override
+	lambertian(texture_id a) : albedo(a) {}
+	virtual bool scatter(const ray& r_in, const hit_record& rec, const texture_table& textures, color& attenuation, ray& scattered) const override
 	{
-		auto scatter_direction = rec.normal + random_unit_vector();
+		auto d = next_2d();
+		auto scatter_direction = rec.normal + sample_unit_vector(d.u, d.v);
 
 		// Catch degenerate scatter direction
 		if (scatter_direction.near_zero())
 			scatter_direction = rec.normal;
 
 		scattered = ray(rec.p, scatter_direction, r_in.time());
-		attenuation = albedo->value(rec.u, rec.v, rec.p);
+		attenuation = textures[albedo].value(rec.u, rec.v, rec.p, textures);
 		return true;
 	}
 
+	// normal + a uniform unit vector is cosine distributed about the normal.
+	virtual bool samples_lights() const override { return true; }
+	virtual color eval(const ray& r_in, const hit_record& rec, const vec3& direction, const texture_table& textures) const override
+	{
+		return scattering_pdf(r_in, rec, direction) * textures[albedo].value(rec.u, rec.v, rec.p, textures);
+	}
+	virtual real scattering_pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const override
+	{
+		auto cosine = dot(rec.normal, unit_vector(direction));
+		return cosine > 0 ? cosine / pi : 0;
+	}
+
 public:
-	shared_ptr<texture> albedo;
+	texture_id albedo;
 };
 
 class metal : public material
 {
 public:
-	metal(const color& a, double f) : albedo(a),  fuzz(f < 1 ? f : 1) {}
+	metal(const color& a, real f) : albedo(a),  fuzz(f < 1 ? f : 1) {}
 
-	virtual bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override
+	virtual bool scatter(const ray& r_in, const hit_record& rec, const texture_table& textures, color& attenuation, ray& scattered) const override
 	{
 		vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-		scattered = ray(rec.p, reflected + fuzz * random_in_unit_sphere(), r_in.time());
+		auto d = next_2d();
+		scattered = ray(rec.p, reflected + fuzz * sample_in_unit_sphere(d.u, d.v, next_1d()), r_in.time());
 		attenuation = albedo;
 		return (dot(scattered.direction(), rec.normal) > 0);
 	}
+	virtual bounce_type type() const override { return bounce_type::glossy; }
 public:
 	color albedo;
-	double fuzz;
+	real fuzz;
 };
 
 class dielectric : public material
 {
 public:
-	dielectric(double index_of_refraction) : ir(index_of_refraction) {}
+	dielectric(real index_of_refraction) : ir(index_of_refraction) {}
 
-	virtual bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override
+	virtual bool scatter(const ray& r_in, const hit_record& rec, const texture_table& textures, color& attenuation, ray& scattered) const override
 	{
 		attenuation = color(1.0, 1.0, 1.0);
-		double refraction_ratio = rec.front_face ? (1.0 / ir) : ir;
+		real refraction_ratio = rec.front_face ? (1.0 / ir) : ir;
 
 		vec3 unit_direction = unit_vector(r_in.direction());
-		double cos_theta = fmin(dot(-unit_direction, rec.normal), 1.0);
-		double sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+		real cos_theta = fmin(dot(-unit_direction, rec.normal), 1.0);
+		real sin_theta = sqrt(1.0 - cos_theta * cos_theta);
 
 		bool cannot_refract = refraction_ratio * sin_theta > 1.0;
+		auto choice = next_1d();
 		vec3 direction;
-		if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_double())
+		if (cannot_refract || reflectance(cos_theta, refraction_ratio) > choice)
 			direction = reflect(unit_direction, rec.normal);
 		else
 			direction = refract(unit_direction, rec.normal, refraction_ratio);
@@ -79,11 +122,12 @@ public:
 		scattered = ray(rec.p, direction, r_in.time());
 		return true;
 	}
+	virtual bounce_type type() const override { return bounce_type::transmission; }
 public:
-	double ir; // Index of Refraction
+	real ir; // Index of Refraction
 
 private:
-	static double reflectance(double cosine, double ref_idx)
+	static real reflectance(real cosine, real ref_idx)
 	{
 		// Use Schlick's approximation for reflectance.
 		auto r0 = (1 - ref_idx) / (1 + ref_idx);	// (1-2)/(1+2)
@@ -95,35 +139,75 @@ private:
 class diffuse_light : public material
 {
 public:
-	diffuse_light(shared_ptr<texture> a) : emit(a) {}
-	diffuse_light(color c) : emit(make_shared<solid_color>(c)) {}
+	diffuse_light(texture_id a) : emit(a) {}
 
-	virtual bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override
+	virtual bool scatter(const ray& r_in, const hit_record& rec, const texture_table& textures, color& attenuation, ray& scattered) const override
 	{
 		return false;
 	}
 
-	virtual color emitted(double u, double v, const point3& p) const override
+	virtual color emitted(real u, real v, const point3& p, const texture_table& textures) const override
 	{
-		return emit->value(u, v, p);
+		return textures[emit].value(u, v, p, textures);
 	}
+
+	virtual bool emissive() const override { return true; }
 public:
-	shared_ptr<texture>emit;
+	texture_id emit;
 };
 
 class isotropic : public material
 {
 public:
-	isotropic(color c) : albedo(make_shared<solid_color>(c)) {}
-	isotropic(shared_ptr<texture> a) : albedo(a) {}
+	isotropic(texture_id a) : albedo(a) {}
 
-	virtual bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override
+	virtual bool scatter(const ray& r_in, const hit_record& rec, const texture_table& textures, color& attenuation, ray& scattered) const override
 	{
-		scattered = ray(rec.p, random_in_unit_sphere(), r_in.time());
-		attenuation = albedo->value(rec.u, rec.v, rec.p);
+		auto d = next_2d();
+		scattered = ray(rec.p, sample_unit_vector(d.u, d.v), r_in.time());
+		attenuation = textures[albedo].value(rec.u, rec.v, rec.p, textures);
 		return true;
 	}
+	virtual bounce_type type() const override { return bounce_type::volume; }
+
+	virtual bool samples_lights() const override { return true; }
+	virtual color eval(const ray& r_in, const hit_record& rec, const vec3& direction, const texture_table& textures) const override
+	{
+		return scattering_pdf(r_in, rec, direction) * textures[albedo].value(rec.u, rec.v, rec.p, textures);
+	}
+	virtual real scattering_pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const override
+	{
+		return 1 / (4 * pi);
+	}
+public:
+	texture_id albedo;
+};
+
+// The scene owns its materials; primitives and hit records refer to them by id, so a hit
+// costs no reference counting.
+class material_table
+{
 public:
-	shared_ptr<texture> albedo;
+	template <typename T, typename... Args>
+	material_id make(Args&&... args)
+	{
+		items.emplace_back(new T(std::forward<Args>(args)...));
+		return static_cast<material_id>(items.size() - 1);
+	}
+
+	const material& operator[](material_id id) const { return *items[id]; }
+	size_t size() const { return items.size(); }
+
+private:
+	std::vector<std::unique_ptr<material> > items;
+};
+
+// Everything the primitives of a scene refer to by id.
+struct scene_assets
+{
+	material_table materials;
+	texture_table textures;
+
+	texture_id solid(const color& c) { return textures.make<solid_color>(c); }
 };
 #endif
\ No newline at end of file
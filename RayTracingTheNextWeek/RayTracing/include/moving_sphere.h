@@ -9,27 +9,37 @@ class moving_sphere : public hittable
 {
 public:
 	moving_sphere() {}
-	moving_sphere(point3 cen0, point3 cen1, double _time0, double _time1, double r, shared_ptr<material> m)
-		: center0(cen0), center1(cen1), time0(_time0), time1(_time1), radius(r), mat_ptr(m)
+	moving_sphere(point3 cen0, point3 cen1, real _time0, real _time1, real r, material_id m)
+		: center0(cen0), center1(cen1), time0(_time0), time1(_time1), radius(r), mat(m)
 	{};
 
-	virtual bool hit(const ray& r_in, double t_min, double t_max, hit_record& rec) const override;
-    virtual bool bounding_box(double _time0, double _time1, aabb& output_box) const override;
-	point3 center(double time) const;
+	virtual bool hit(const ray& r_in, real t_min, real t_max, hit_record& rec) const override;
+    virtual bool bounding_box(real _time0, real _time1, aabb& output_box) const override;
+	virtual bool motion_bounds(real _time0, real _time1, aabb& start, aabb& end) const override
+	{
+		// The centre moves linearly, so the boxes at the two ends are all a motion BVH needs.
+		vec3 r(radius, radius, radius);
+		start = aabb(center(_time0) - r, center(_time0) + r);
+		end = aabb(center(_time1) - r, center(_time1) + r);
+		return true;
+	}
+	virtual bool convex() const override { return true; }
+	virtual bool hit_interval(const ray& r, real& t_enter, real& t_exit) const override;
+	point3 center(real time) const;
 
 public:
 	point3 center0, center1;
-	double time0, time1;
-	double radius;
-	shared_ptr<material> mat_ptr;
+	real time0, time1;
+	real radius;
+	material_id mat;
 };
 
-point3 moving_sphere::center(double time) const
+point3 moving_sphere::center(real time) const
 {
 	return center0 + ((time - time0) / (time1 - time0)) * (center1 - center0);
 }
 
-bool moving_sphere::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+bool moving_sphere::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
     vec3 oc = r.origin() - center(r.time());
     auto a = r.direction().length_squared();
     auto half_b = dot(oc, r.direction());
@@ -51,12 +61,28 @@ bool moving_sphere::hit(const ray& r, double t_min, double t_max, hit_record& re
     rec.p = r.at(rec.t);
     auto outward_normal = (rec.p - center(r.time())) / radius;
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mat_ptr;
+    rec.mat_id = mat;
 
     return true;
 }
 
-bool moving_sphere::bounding_box(double _time0, double _time1, aabb& output_box) const
+bool moving_sphere::hit_interval(const ray& r, real& t_enter, real& t_exit) const
+{
+    vec3 oc = r.origin() - center(r.time());
+    auto a = r.direction().length_squared();
+    auto half_b = dot(oc, r.direction());
+    auto c = oc.length_squared() - radius * radius;
+
+    auto discriminant = half_b * half_b - a * c;
+    if (discriminant < 0) return false;
+    auto sqrtd = sqrt(discriminant);
+
+    t_enter = (-half_b - sqrtd) / a;
+    t_exit = (-half_b + sqrtd) / a;
+    return true;
+}
+
+bool moving_sphere::bounding_box(real _time0, real _time1, aabb& output_box) const
 {
     aabb box0(center(_time0) - vec3(radius, radius, radius), center(_time0) + vec3(radius, radius, radius));
     aabb box1(center(_time1) - vec3(radius, radius, radius), center(_time1) + vec3(radius, radius, radius));
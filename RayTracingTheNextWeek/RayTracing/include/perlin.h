@@ -2,34 +2,100 @@
 #define PERLIN_H
 
 #include "rtweekend.h"
+#include "simd.h"
 
-class perlin
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// The gradients and permutations of one noise seed. Tables are made once per seed and
+// shared by every perlin using that seed; they are drawn from their own generator, so
+// building a scene's noise no longer consumes the scene's random numbers.
+class perlin_table
 {
 public:
-	perlin()
+	static const int point_count = 256;
+
+	static const perlin_table& get(uint64_t seed)
 	{
-		//ranfloat = new double[point_count];
-		ranvec = new vec3[point_count];
+		static std::mutex mutex;
+		static std::map<uint64_t, std::unique_ptr<perlin_table> > tables;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		auto& table = tables[seed];
+		if (!table)
+			table.reset(new perlin_table(seed));
+		return *table;
+	}
+
+	int hash(int i, int j, int k) const
+	{
+		return perm_x[i & 255] ^ perm_y[j & 255] ^ perm_z[k & 255];
+	}
+
+	// The permuted coordinates of the two lattice planes around i, j and k on each axis;
+	// corner (di, dj, dk) hashes to hx[di] ^ hy[dj] ^ hz[dk].
+	void corner_hashes(int i, int j, int k, int hx[2], int hy[2], int hz[2]) const
+	{
+		hx[0] = perm_x[i & 255];
+		hx[1] = perm_x[(i + 1) & 255];
+		hy[0] = perm_y[j & 255];
+		hy[1] = perm_y[(j + 1) & 255];
+		hz[0] = perm_z[k & 255];
+		hz[1] = perm_z[(k + 1) & 255];
+	}
+
+public:
+	vec3 ranvec[point_count];
+
+	// ranvec again in float, padded to four so that one gradient is one aligned load, for
+	// the packet path
+	alignas(16) float gradient[point_count][4];
+
+private:
+	explicit perlin_table(uint64_t seed)
+	{
+		pcg32 rng(seed, 0x7065726c696eULL);
 		for (int i = 0; i < point_count; ++i)
 		{
-			//ranfloat[i] = random_double();
-			ranvec[i] = unit_vector(vec3::random(-1, 1));
+			vec3 v;
+			for (int a = 0; a < 3; a++)
+				v[a] = -1 + 2 * rng.next_double();
+			ranvec[i] = unit_vector(v);
+			for (int a = 0; a < 3; a++)
+				gradient[i][a] = static_cast<float>(ranvec[i][a]);
+			gradient[i][3] = 0;
 		}
-		perm_x = perlin_generate_perm();
-		perm_y = perlin_generate_perm();
-		perm_z = perlin_generate_perm();
+		generate_perm(perm_x, rng);
+		generate_perm(perm_y, rng);
+		generate_perm(perm_z, rng);
 	}
 
-	~perlin()
+	static void generate_perm(int* p, pcg32& rng)
 	{
-		delete[] ranvec;
-		//delete[] ranfloat;
-		delete[] perm_x;
-		delete[] perm_y;
-		delete[] perm_z;
+		for (int i = 0; i < point_count; i++)
+			p[i] = i;
+
+		for (int i = point_count - 1; i > 0; i--)
+		{
+			int target = std::min(static_cast<int>(rng.next_double() * (i + 1)), i);
+			std::swap(p[i], p[target]);
+		}
 	}
 
-	double noise(const point3& p) const
+private:
+	int perm_x[point_count];
+	int perm_y[point_count];
+	int perm_z[point_count];
+};
+
+class perlin
+{
+public:
+	perlin(uint64_t seed = 0) : table(&perlin_table::get(seed)) {}
+
+	real noise(const point3& p) const
 	{
 		auto u = p.x() - floor(p.x());
 		auto v = p.y() - floor(p.y());
@@ -38,27 +104,16 @@ public:
 		auto i = static_cast<int>(floor(p.x()));
 		auto j = static_cast<int>(floor(p.y()));
 		auto k = static_cast<int>(floor(p.z()));
-		//double c[2][2][2];
 		vec3 c[2][2][2];
 
 		for (int di = 0; di < 2; di++)
 			for (int dj = 0; dj < 2; dj++)
 				for (int dk = 0; dk < 2; dk++)
-					//c[di][dj][dk] = ranfloat[
-					//	perm_x[(i + di) & 255] ^
-					//	perm_y[(j + dj) & 255] ^
-					//	perm_z[(k + dk) & 255]
-					//];
-					c[di][dj][dk] = ranvec[
-						perm_x[(i + di) & 255] ^
-						perm_y[(j + dj) & 255] ^
-						perm_z[(k + dk) & 255]
-					];
-		//return trilinear_interp(c, u, v, w);
+					c[di][dj][dk] = table->ranvec[table->hash(i + di, j + dj, k + dk)];
 		return perlin_interp(c, u, v, w);
 	}
 
-	double turb(const point3& p, int depth = 7) const	// turbulence Ǹ֮
+	real turb(const point3& p, int depth = 7) const	// turbulence Ǹ֮
 	{
 		auto accum = 0.0;
 		auto temp_p = p;
@@ -72,54 +127,28 @@ public:
 		}
 		return fabs(accum);
 	}
-private:
-	static const int point_count = 256;
-	//double* ranfloat;
-	vec3* ranvec;
-	int* perm_x;
-	int* perm_y;
-	int* perm_z;
-
-	static int* perlin_generate_perm()
-	{
-		auto p = new int[point_count];
-		for (int i = 0; i < perlin::point_count; i++)
-			p[i] = i;
 
-		permute(p, point_count);
+	// turb with packet_width octaves per pass, one in each float lane. The lattice cell and
+	// the fraction within it are still found in double, so octaves far from the origin keep
+	// their precision; the gradients and the interpolation run in float and differ from
+	// turb() by about 1e-6.
+	real turb_fast(const point3& p, int depth = 7) const;
 
-		return p;
-	}
+private:
+	const perlin_table* table;
 
-	static void permute(int* p, int n)
+	// floor(x) as an int, without the call
+	static int lattice(real x)
 	{
-		for (int i = n - 1; i > 0; i--)
-		{
-			int target = random_int(0, i);
-			int tmp = p[i];
-			p[i] = p[target];
-			p[target] = tmp;
-		}
+		auto i = static_cast<int>(x);
+		return i - (i > x);
 	}
 
-	static double trilinear_interp(double c[2][2][2], double u, double v, double w)	// ʹֵ
-	{
-		u = u * u * (3 - 2 * u);
-		v = v * v * (3 - 2 * v);
-		w = w * w * (3 - 2 * w);
-		auto accum = 0.0;
+	// The weights of the corners (i, j, k) in perlin_interp, along x. They take (1 - j),
+	// not (1 - i): the noise has always been interpolated this way and keeps its look.
+	static real x_weight(int i, int j, real uu) { return i * uu + (1 - j) * (1 - uu); }
 
-		for (int i = 0; i < 2; i++)
-			for (int j = 0; j < 2; j++)
-				for (int k = 0; k < 2; k++)
-					accum += (i * u + (1 - i) * (1 - u)) 
-						   * (j * v + (1 - j) * (1 - v)) 
-						   * (k * w + (1 - k) * (1 - w)) 
-						   * c[i][j][k];
-		return accum;
-	}
-
-	static double perlin_interp(vec3 c[2][2][2], double u, double v, double w)	// ʹֵ
+	static real perlin_interp(vec3 c[2][2][2], real u, real v, real w)	// ʹֵ
 	{
 		auto uu = u * u * (3 - 2 * u);
 		auto vv = v * v * (3 - 2 * v);
@@ -131,7 +160,7 @@ private:
 				for (int k = 0; k < 2; k++)
 				{
 					vec3 weight_v(u - i, v - j, w - k);
-					accum += (i * uu + (1 - j) * (1 - uu))
+					accum += x_weight(i, j, uu)
 						   * (j * vv + (1 - j) * (1 - vv))
 						   * (k * ww + (1 - k) * (1 - ww))
 						   * dot(c[i][j][k], weight_v);
@@ -139,4 +168,83 @@ private:
 		return accum;
 	}
 };
+
+real perlin::turb_fast(const point3& p, int depth) const
+{
+	alignas(32) float u[packet_width], v[packet_width], w[packet_width], weight[packet_width];
+	alignas(32) int corner[8][packet_width];	// gradient index of each corner in each lane
+
+	const packet_float one = packet_set1(1.0f);
+	const packet_float two = packet_set1(2.0f);
+	const packet_float three = packet_set1(3.0f);
+
+	auto accum = 0.0;
+	auto temp_p = p;
+	auto octave_weight = 1.0;
+	for (int first = 0; first < depth; first += packet_width)
+	{
+		for (int lane = 0; lane < packet_width; lane++)
+		{
+			if (first + lane >= depth)
+			{
+				// Unused lanes weigh nothing.
+				u[lane] = v[lane] = w[lane] = weight[lane] = 0;
+				for (int c = 0; c < 8; c++)
+					corner[c][lane] = 0;
+				continue;
+			}
+
+			auto i = lattice(temp_p.x());
+			auto j = lattice(temp_p.y());
+			auto k = lattice(temp_p.z());
+			u[lane] = static_cast<float>(temp_p.x() - i);
+			v[lane] = static_cast<float>(temp_p.y() - j);
+			w[lane] = static_cast<float>(temp_p.z() - k);
+			weight[lane] = static_cast<float>(octave_weight);
+
+			int hx[2], hy[2], hz[2];
+			table->corner_hashes(i, j, k, hx, hy, hz);
+			for (int c = 0; c < 8; c++)
+			{
+				corner[c][lane] = hx[c >> 2] ^ hy[(c >> 1) & 1] ^ hz[c & 1];
+			}
+
+			octave_weight *= 0.5;
+			temp_p *= 2;
+		}
+
+		auto pu = packet_load(u);
+		auto pv = packet_load(v);
+		auto pw = packet_load(w);
+		auto uu = packet_mul(packet_mul(pu, pu), packet_sub(three, packet_mul(two, pu)));
+		auto vv = packet_mul(packet_mul(pv, pv), packet_sub(three, packet_mul(two, pv)));
+		auto ww = packet_mul(packet_mul(pw, pw), packet_sub(three, packet_mul(two, pw)));
+		packet_float wy[2] = { packet_sub(one, vv), vv };
+		packet_float wz[2] = { packet_sub(one, ww), ww };
+		packet_float du[2] = { pu, packet_sub(pu, one) };
+		packet_float dv[2] = { pv, packet_sub(pv, one) };
+		packet_float dw[2] = { pw, packet_sub(pw, one) };
+
+		// x_weight for (i, j) = (0, 0), (0, 1), (1, 0), (1, 1)
+		packet_float wx[4] = { packet_sub(one, uu), packet_set1(0.0f), one, uu };
+
+		auto sum = packet_set1(0.0f);
+		for (int c = 0; c < 8; c++)
+		{
+			int i = c >> 2, j = (c >> 1) & 1, k = c & 1;
+			if (i == 0 && j == 1)
+				continue;	// x_weight is 0
+			packet_float gx, gy, gz;
+			packet_gather_xyz(table->gradient, corner[c], gx, gy, gz);
+			auto d = packet_add(packet_add(packet_mul(gx, du[i]), packet_mul(gy, dv[j])), packet_mul(gz, dw[k]));
+			sum = packet_add(sum, packet_mul(packet_mul(packet_mul(wx[2 * i + j], wy[j]), wz[k]), d));
+		}
+
+		alignas(32) float octaves[packet_width];
+		packet_store(octaves, packet_mul(sum, packet_load(weight)));
+		for (int lane = 0; lane < packet_width; lane++)
+			accum += octaves[lane];
+	}
+	return fabs(accum);
+}
 #endif
\ No newline at end of file
@@ -0,0 +1,178 @@
+#ifndef PRIMITIVE_STORE_H
+#define PRIMITIVE_STORE_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "sphere.h"
+#include "moving_sphere.h"
+#include "aarect.h"
+#include "box.h"
+#include "box_set.h"
+#include "constant_medium.h"
+#include "sphere_set.h"
+#include "instance.h"
+#include "render_stats.h"
+
+#include <cstdint>
+#include <typeinfo>
+#include <vector>
+
+// Primitives kept by value in one array per type, addressed by a type tag plus an index.
+// A BVH leaf dispatches on the tag with a switch; the calls below name the class, so they
+// are not virtual and the compiler can inline the intersection code. hittable_lists are
+// flattened into their parts. Any other hittable, and the children of translate, rotate_y,
+// instance and constant_medium, are still reached through hittable::hit.
+
+enum class primitive_type : uint32_t
+{
+	sphere, moving_sphere, xy_rect, xz_rect, yz_rect, box, sphere_set, box_set,
+	translate, rotate_y, instance, constant_medium, other
+};
+const int primitive_type_count = 13;
+const char* const primitive_type_names[primitive_type_count] = {
+	"sphere", "moving_sphere", "xy_rect", "xz_rect", "yz_rect", "box", "sphere_set", "box_set",
+	"translate", "rotate_y", "instance", "constant_medium", "other"
+};
+static_assert(primitive_type_count <= max_stat_primitive_types, "render_stats counts too few primitive types");
+
+struct primitive_ref
+{
+	primitive_type type;
+	uint32_t index;		// into the array of that type
+};
+
+class primitive_store
+{
+public:
+	// Appends the primitives making up object to out. With devirtualize false, or for a type
+	// the store does not know, the object is kept behind its shared_ptr.
+	void add(const shared_ptr<hittable>& object, bool devirtualize, std::vector<primitive_ref>& out);
+
+	bool hit(primitive_ref p, const ray& r, real t_min, real t_max, hit_record& rec) const
+	{
+		RT_STAT(primitive_tests[static_cast<int>(p.type)]++);
+		switch (p.type)
+		{
+		case primitive_type::sphere:			return spheres[p.index].sphere::hit(r, t_min, t_max, rec);
+		case primitive_type::moving_sphere:		return moving_spheres[p.index].moving_sphere::hit(r, t_min, t_max, rec);
+		case primitive_type::xy_rect:			return xy_rects[p.index].xy_rect::hit(r, t_min, t_max, rec);
+		case primitive_type::xz_rect:			return xz_rects[p.index].xz_rect::hit(r, t_min, t_max, rec);
+		case primitive_type::yz_rect:			return yz_rects[p.index].yz_rect::hit(r, t_min, t_max, rec);
+		case primitive_type::box:				return boxes[p.index].box::hit(r, t_min, t_max, rec);
+		case primitive_type::sphere_set:		return sphere_sets[p.index].sphere_set::hit(r, t_min, t_max, rec);
+		case primitive_type::box_set:			return box_sets[p.index].box_set::hit(r, t_min, t_max, rec);
+		case primitive_type::translate:			return translates[p.index].translate::hit(r, t_min, t_max, rec);
+		case primitive_type::rotate_y:			return rotations[p.index].rotate_y::hit(r, t_min, t_max, rec);
+		case primitive_type::instance:			return instances[p.index].instance::hit(r, t_min, t_max, rec);
+		case primitive_type::constant_medium:	return media[p.index].constant_medium::hit(r, t_min, t_max, rec);
+		default:								return others[p.index]->hit(r, t_min, t_max, rec);
+		}
+	}
+
+	bool bounding_box(primitive_ref p, real time0, real time1, aabb& output_box) const
+	{
+		return get(p).bounding_box(time0, time1, output_box);
+	}
+
+	bool motion_bounds(primitive_ref p, real time0, real time1, aabb& start, aabb& end) const
+	{
+		return get(p).motion_bounds(time0, time1, start, end);
+	}
+
+	// The object behind an untyped reference, or null.
+	const hittable* virtual_object(primitive_ref p) const
+	{
+		return p.type == primitive_type::other ? others[p.index].get() : nullptr;
+	}
+
+private:
+	const hittable& get(primitive_ref p) const;
+
+	template <typename T>
+	static primitive_ref push(std::vector<T>& items, primitive_type type, const hittable& object)
+	{
+		items.push_back(static_cast<const T&>(object));
+		return { type, static_cast<uint32_t>(items.size() - 1) };
+	}
+
+	primitive_ref push_virtual(const shared_ptr<hittable>& object)
+	{
+		others.push_back(object);
+		return { primitive_type::other, static_cast<uint32_t>(others.size() - 1) };
+	}
+
+private:
+	std::vector<sphere> spheres;
+	std::vector<moving_sphere> moving_spheres;
+	std::vector<xy_rect> xy_rects;
+	std::vector<xz_rect> xz_rects;
+	std::vector<yz_rect> yz_rects;
+	std::vector<box> boxes;
+	std::vector<sphere_set> sphere_sets;
+	std::vector<box_set> box_sets;
+	std::vector<translate> translates;
+	std::vector<rotate_y> rotations;
+	std::vector<instance> instances;
+	std::vector<constant_medium> media;
+	std::vector<shared_ptr<hittable> > others;
+};
+
+void primitive_store::add(const shared_ptr<hittable>& object, bool devirtualize, std::vector<primitive_ref>& out)
+{
+	const auto& type = typeid(*object);
+	if (!devirtualize)
+		out.push_back(push_virtual(object));
+	else if (type == typeid(hittable_list))
+		for (const auto& part : static_cast<const hittable_list&>(*object).objects)
+			add(part, devirtualize, out);
+	else if (type == typeid(sphere))
+		out.push_back(push(spheres, primitive_type::sphere, *object));
+	else if (type == typeid(moving_sphere))
+		out.push_back(push(moving_spheres, primitive_type::moving_sphere, *object));
+	else if (type == typeid(xy_rect))
+		out.push_back(push(xy_rects, primitive_type::xy_rect, *object));
+	else if (type == typeid(xz_rect))
+		out.push_back(push(xz_rects, primitive_type::xz_rect, *object));
+	else if (type == typeid(yz_rect))
+		out.push_back(push(yz_rects, primitive_type::yz_rect, *object));
+	else if (type == typeid(box))
+		out.push_back(push(boxes, primitive_type::box, *object));
+	else if (type == typeid(sphere_set))
+		out.push_back(push(sphere_sets, primitive_type::sphere_set, *object));
+	else if (type == typeid(box_set))
+		out.push_back(push(box_sets, primitive_type::box_set, *object));
+	else if (type == typeid(translate))
+		out.push_back(push(translates, primitive_type::translate, *object));
+	else if (type == typeid(rotate_y))
+		out.push_back(push(rotations, primitive_type::rotate_y, *object));
+	else if (type == typeid(instance))
+		out.push_back(push(instances, primitive_type::instance, *object));
+	else if (type == typeid(constant_medium))
+		out.push_back(push(media, primitive_type::constant_medium, *object));
+	else
+		out.push_back(push_virtual(object));
+}
+
+const hittable& primitive_store::get(primitive_ref p) const
+{
+	switch (p.type)
+	{
+	case primitive_type::sphere:			return spheres[p.index];
+	case primitive_type::moving_sphere:		return moving_spheres[p.index];
+	case primitive_type::xy_rect:			return xy_rects[p.index];
+	case primitive_type::xz_rect:			return xz_rects[p.index];
+	case primitive_type::yz_rect:			return yz_rects[p.index];
+	case primitive_type::box:				return boxes[p.index];
+	case primitive_type::sphere_set:		return sphere_sets[p.index];
+	case primitive_type::box_set:			return box_sets[p.index];
+	case primitive_type::translate:			return translates[p.index];
+	case primitive_type::rotate_y:			return rotations[p.index];
+	case primitive_type::instance:			return instances[p.index];
+	case primitive_type::constant_medium:	return media[p.index];
+	default:								return *others[p.index];
+	}
+}
+
+#endif
\ No newline at end of file
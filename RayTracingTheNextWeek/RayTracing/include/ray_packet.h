@@ -0,0 +1,49 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "rtweekend.h"
+
+#include "simd.h"
+#include "sampler.h"
+
+// A handful of rays traced through the BVH together, one per SIMD lane: 8 with AVX, 4 with
+// SSE. Packets only pay off while the rays stay coherent, so they are used for camera rays
+// of neighbouring pixels and every later bounce is traced on its own.
+//
+// Each ray keeps its own random stream; the BVH swaps it in while that ray's primitives are
+// tested, since a hit test may draw random numbers (constant_medium does). Each also keeps
+// its place in its sample, for shading it afterwards.
+
+struct ray_packet
+{
+	ray rays[packet_width];
+	pcg32 rng[packet_width];	// each ray's random stream
+	sample_context sample[packet_width];
+	int count = 0;				// rays in use; the remaining lanes are inactive
+
+	void add(const ray& r)
+	{
+		rays[count] = r;
+		rng[count] = random_generator();
+		sample[count] = current_sample();
+		count++;
+	}
+
+	int active_mask() const { return (1 << count) - 1; }
+
+	// True when every ray's direction has the same sign on each axis, so one near-to-far
+	// child order suits the whole packet.
+	bool coherent() const
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			bool neg = rays[0].direction()[a] < 0;
+			for (int k = 1; k < count; k++)
+				if ((rays[k].direction()[a] < 0) != neg)
+					return false;
+		}
+		return true;
+	}
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,255 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "hittable.h"
+#include "material.h"
+#include "light_list.h"
+#include "linear_bvh.h"
+#include "ray_packet.h"
+#include "integrator.h"
+#include "adaptive_sampler.h"
+#include "framebuffer.h"
+#include "sampler.h"
+#include "render_stats.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+struct tile
+{
+	int x0, y0;	// lower-left pixel, inclusive
+	int x1, y1;	// upper-right pixel, exclusive
+};
+
+// Everything the samples of a render depend on besides the build. Samples are only mixed
+// when this matches: a checkpoint's with the render resuming it, a worker's with its
+// coordinator's.
+struct render_job
+{
+	uint64_t seed = 0;
+	int32_t scene_id = 0;
+	int32_t width = 0;
+	int32_t height = 0;
+	int32_t samples_per_pixel = 0;	// the sample counts the sampler is built for
+	int32_t max_spp = 0;
+	int32_t sampler = 0;		// sampler_type
+	int32_t max_depth = 0;
+	int32_t rr_start_depth = 0;
+	int32_t max_bounces[bounce_type_count] = {};
+	int32_t sample_lights = 0;
+
+	// Calls f on each field in turn, for writing them out and reading them back.
+	template <typename Job, typename F>
+	static void for_each_field(Job& job, F f)
+	{
+		f(job.seed);
+		f(job.scene_id);
+		f(job.width);
+		f(job.height);
+		f(job.samples_per_pixel);
+		f(job.max_spp);
+		f(job.sampler);
+		f(job.max_depth);
+		f(job.rr_start_depth);
+		for (auto& n : job.max_bounces)
+			f(n);
+		f(job.sample_lights);
+	}
+
+	// The option that differs from other's, or null if their samples can be mixed. The
+	// sample counts may differ: a render can be taken higher, and keeps the first's.
+	const char* mismatch(const render_job& other) const
+	{
+		if (scene_id != other.scene_id)
+			return "--scene";
+		if (width != other.width || height != other.height)
+			return "--width";
+		if (seed != other.seed)
+			return "--seed";
+		if (sampler != other.sampler)
+			return "--sampler";
+		if (max_depth != other.max_depth)
+			return "--max-depth";
+		if (rr_start_depth != other.rr_start_depth)
+			return "--rr-depth";
+		for (int i = 0; i < bounce_type_count; i++)
+			if (max_bounces[i] != other.max_bounces[i])
+				return "--max-bounces";
+		if (sample_lights != other.sample_lights)
+			return "--no-light-sampling";
+		return nullptr;
+	}
+};
+
+// Takes every pixel of the tile from the samples it has up to its target, each sample drawing
+// its dimensions from source (null for independent random numbers).
+void render_tile(const tile& t, const camera& cam, const color& background, const hittable& world,
+				 const scene_assets& assets, const light_list& lights, int image_width, int image_height, const integrator_settings& integrator,
+				 uint64_t seed, const sampler* source, sample_accumulator& samples)
+{
+	for (int j = t.y0; j < t.y1; ++j)
+	{
+		for (int i = t.x0; i < t.x1; ++i)
+		{
+			auto pixel = static_cast<uint64_t>(j) * image_width + i;
+			auto work = thread_work();
+
+			for (int s = samples.count(pixel); s < samples.target(pixel); ++s) {
+				seed_random(seed, pixel, s);
+				start_sample(source, pixel, s);
+				auto jitter = next_2d();
+				auto u = (i + jitter.u) / (image_width - 1);
+				auto v = (j + jitter.v) / (image_height - 1);
+				ray r = cam.get_ray(u, v);
+				samples.add(pixel, ray_color(r, background, world, assets, lights, integrator));
+			}
+			add_pixel_cost(pixel, thread_work() - work);
+		}
+	}
+}
+
+// Same as render_tile, but the camera rays of each block of packet_width neighbouring pixels
+// (for one sample index) go through the scene BVH as a packet. Shading and every later
+// bounce are traced per ray. Each pixel still draws from its own per-sample stream, and a
+// pixel that has reached its target leaves the packet.
+void render_tile_packets(const tile& t, const camera& cam, const color& background, const hittable& world,
+						 const scene_assets& assets, const light_list& lights, const linear_bvh& scene_bvh, int image_width, int image_height,
+						 const integrator_settings& integrator, uint64_t seed, const sampler* source, sample_accumulator& samples)
+{
+	const int block_width = packet_width / 2;
+	const int block_height = 2;
+
+	for (int by = t.y0; by < t.y1; by += block_height)
+	{
+		for (int bx = t.x0; bx < t.x1; bx += block_width)
+		{
+			int px[packet_width];
+			int py[packet_width];
+			uint64_t pixel[packet_width];
+			int n = 0;
+			int first = 0x7fffffff;
+			int last = 0;
+			for (int j = by; j < std::min(by + block_height, t.y1); ++j)
+			{
+				for (int i = bx; i < std::min(bx + block_width, t.x1); ++i)
+				{
+					px[n] = i;
+					py[n] = j;
+					pixel[n] = static_cast<uint64_t>(j) * image_width + i;
+					first = std::min(first, samples.count(pixel[n]));
+					last = std::max(last, samples.target(pixel[n]));
+					n++;
+				}
+			}
+
+			for (int s = first; s < last; ++s)
+			{
+				ray_packet packet;
+				int lane_pixel[packet_width];
+				for (int k = 0; k < n; k++)
+				{
+					if (s < samples.count(pixel[k]) || s >= samples.target(pixel[k]))
+						continue;
+					seed_random(seed, pixel[k], s);
+					start_sample(source, pixel[k], s);
+					auto jitter = next_2d();
+					auto u = (px[k] + jitter.u) / (image_width - 1);
+					auto v = (py[k] + jitter.v) / (image_height - 1);
+					lane_pixel[packet.count] = k;
+					packet.add(cam.get_ray(u, v));
+				}
+
+				real t_max[packet_width];
+				hit_record recs[packet_width];
+				std::fill(t_max, t_max + packet_width, static_cast<real>(infinity));
+				auto work = thread_work();
+				int hits = integrator.max_depth > 0 ? scene_bvh.hit_packet(packet, packet.active_mask(), ray_t_min, t_max, recs) : 0;
+				auto packet_share = packet.count > 0 ? (thread_work() - work) / packet.count : 0;
+
+				for (int k = 0; k < packet.count; k++)
+				{
+					random_generator() = packet.rng[k];
+					current_sample() = packet.sample[k];
+					work = thread_work();
+					samples.add(pixel[lane_pixel[k]], ray_color(packet.rays[k], (hits >> k) & 1, recs[k], background, world, assets, lights, integrator));
+					add_pixel_cost(pixel[lane_pixel[k]], packet_share + thread_work() - work);
+				}
+			}
+		}
+	}
+}
+
+// The tiles of an image, top row first, left to right, the same order the scanline loop used.
+std::vector<tile> make_tiles(int image_width, int image_height, int tile_size)
+{
+	std::vector<tile> tiles;
+	for (int y1 = image_height; y1 > 0; y1 -= tile_size)
+		for (int x0 = 0; x0 < image_width; x0 += tile_size)
+			tiles.push_back({ x0, std::max(y1 - tile_size, 0), std::min(x0 + tile_size, image_width), y1 });
+	return tiles;
+}
+
+// The counters of every thread that rendered, added up. Only meaningful in builds with
+// RT_STATS, and only once the workers are idle.
+void report_render_stats(std::ostream& out)
+{
+	auto& registry = render_stats_registry::get();
+	auto stats = registry.total();
+	out << "Render stats (" << registry.thread_count() << " threads):\n"
+		<< "  paths: " << stats.paths << ", mean length "
+		<< (stats.paths ? static_cast<double>(stats.path_vertices) / stats.paths : 0.0) << "\n"
+		<< "  path lengths:";
+	for (int i = 0; i < path_length_buckets; i++)
+	{
+		if (stats.path_lengths[i])
+			out << ' ' << i << (i == path_length_buckets - 1 ? "+" : "") << ": " << stats.path_lengths[i];
+	}
+	out << "\n  BVH nodes: " << stats.bvh_nodes << ", box tests: " << stats.box_tests << "\n"
+		<< "  primitive tests:";
+	for (int i = 0; i < primitive_type_count; i++)
+	{
+		if (stats.primitive_tests[i])
+			out << ' ' << primitive_type_names[i] << ": " << stats.primitive_tests[i];
+	}
+	out << "\n  scatters:";
+	for (int i = 0; i < bounce_type_count; i++)
+		out << ' ' << bounce_type_names[i] << ": " << stats.scatters[i];
+	out << ", absorbed: " << stats.absorbed << "\n"
+		<< "  shadow rays: " << stats.shadow_rays << "\n";
+}
+
+// The traversal work spent on each pixel in false colour, black through purple, red and
+// yellow to white. The scale tops out at the 99th percentile, so that a few very expensive
+// pixels do not leave the rest black.
+framebuffer cost_heatmap(const std::vector<uint64_t>& costs, int width, int height)
+{
+	framebuffer image(width, height);
+	if (costs.size() != static_cast<size_t>(width) * height)
+		return image;
+
+	std::vector<uint64_t> sorted(costs);
+	auto top = sorted.begin() + (sorted.size() - 1) * 99 / 100;
+	std::nth_element(sorted.begin(), top, sorted.end());
+	real scale = *top > 0 ? static_cast<real>(*top) : 1;
+
+	const color ramp[] = { color(0, 0, 0), color(0.5, 0, 0.6), color(0.9, 0.1, 0.1), color(1, 0.85, 0), color(1, 1, 1) };
+	const int segments = sizeof(ramp) / sizeof(ramp[0]) - 1;
+	for (int j = 0; j < height; ++j)
+	{
+		for (int i = 0; i < width; ++i)
+		{
+			real x = fmin(costs[static_cast<size_t>(j) * width + i] / scale, static_cast<real>(1)) * segments;
+			auto k = std::min(static_cast<int>(x), segments - 1);
+			auto c = ramp[k] + (x - k) * (ramp[k + 1] - ramp[k]);
+			image.set(i, j, c * c);	// the writers take the square root again
+		}
+	}
+	return image;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,146 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Counters of the work a render does, for finding where its time goes. They exist only in
+// builds with RT_STATS; otherwise RT_STAT(...) compiles to nothing and the renderer is the
+// same as without them. Each thread counts into its own render_stats, and the registry
+// adds them up once the workers are idle.
+//
+//     RT_STAT(bvh_nodes++);
+
+const int max_stat_primitive_types = 16;	// at least primitive_type's count
+const int max_stat_bounce_types = 4;		// bounce_type_count
+const int path_length_buckets = 17;			// the last one holds every longer path
+
+struct render_stats
+{
+	uint64_t bvh_nodes = 0;			// nodes visited, by linear_bvh and bvh_node
+	uint64_t box_tests = 0;			// aabb::hit and BVH node slab tests, a packet's counting once
+	uint64_t primitive_tests[max_stat_primitive_types] = {};	// by primitive_type
+	uint64_t paths = 0;
+	uint64_t path_vertices = 0;		// surfaces and media hit, over all paths
+	uint64_t path_lengths[path_length_buckets] = {};
+	uint64_t scatters[max_stat_bounce_types] = {};	// by bounce_type of the material
+	uint64_t absorbed = 0;			// hits whose material did not scatter (lights, mostly)
+	uint64_t shadow_rays = 0;
+
+	// Traversal work: node visits, box tests and primitive tests. The heatmap's cost.
+	uint64_t work() const
+	{
+		auto total = bvh_nodes + box_tests;
+		for (auto n : primitive_tests)
+			total += n;
+		return total;
+	}
+
+	void add_path(int length)
+	{
+		paths++;
+		path_vertices += length;
+		path_lengths[length < path_length_buckets - 1 ? length : path_length_buckets - 1]++;
+	}
+
+	void add(const render_stats& other)
+	{
+		bvh_nodes += other.bvh_nodes;
+		box_tests += other.box_tests;
+		for (int i = 0; i < max_stat_primitive_types; i++)
+			primitive_tests[i] += other.primitive_tests[i];
+		paths += other.paths;
+		path_vertices += other.path_vertices;
+		for (int i = 0; i < path_length_buckets; i++)
+			path_lengths[i] += other.path_lengths[i];
+		for (int i = 0; i < max_stat_bounce_types; i++)
+			scatters[i] += other.scatters[i];
+		absorbed += other.absorbed;
+		shadow_rays += other.shadow_rays;
+	}
+};
+
+// Every thread's counters, and the traversal work spent on each pixel. A pixel's samples are
+// taken by one thread per pass and passes do not overlap, so its cost needs no lock.
+class render_stats_registry
+{
+public:
+	static render_stats_registry& get()
+	{
+		static render_stats_registry registry;
+		return registry;
+	}
+
+	render_stats* add_thread()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		threads.emplace_back(new render_stats());
+		return threads.back().get();
+	}
+
+	// Only while no thread is counting.
+	render_stats total() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		render_stats sum;
+		for (const auto& t : threads)
+			sum.add(*t);
+		return sum;
+	}
+
+	size_t thread_count() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return threads.size();
+	}
+
+	void reset_pixels(size_t count) { pixel_costs.assign(count, 0); }
+	void add_pixel_cost(size_t pixel, uint64_t cost)
+	{
+		if (pixel < pixel_costs.size())
+			pixel_costs[pixel] += cost;
+	}
+	const std::vector<uint64_t>& costs() const { return pixel_costs; }
+
+private:
+	render_stats_registry() {}
+
+	mutable std::mutex mutex;
+	std::vector<std::unique_ptr<render_stats> > threads;
+	std::vector<uint64_t> pixel_costs;
+};
+
+#if defined(RT_STATS)
+inline render_stats& thread_render_stats()
+{
+	thread_local render_stats* stats = render_stats_registry::get().add_thread();
+	return *stats;
+}
+
+#define RT_STAT(expr) ((void)(thread_render_stats().expr))
+#else
+#define RT_STAT(expr) ((void)0)
+#endif
+
+// The traversal work this thread has done so far, and a charge of some of it to a pixel; a
+// constant 0 and nothing without RT_STATS.
+inline uint64_t thread_work()
+{
+#if defined(RT_STATS)
+	return thread_render_stats().work();
+#else
+	return 0;
+#endif
+}
+
+inline void add_pixel_cost(uint64_t pixel, uint64_t cost)
+{
+#if defined(RT_STATS)
+	render_stats_registry::get().add_pixel_cost(static_cast<size_t>(pixel), cost);
+#endif
+}
+
+#endif
\ No newline at end of file
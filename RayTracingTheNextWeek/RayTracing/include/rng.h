@@ -0,0 +1,60 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+// PCG32 (O'Neill, pcg-random.org): 64-bit LCG state with a permuted 32-bit output.
+// Two words of state, no locks and no allocation, so every thread can own one and
+// seeding a fresh stream per sample costs a couple of multiplies.
+class pcg32
+{
+public:
+	pcg32() { seed(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL); }
+	pcg32(uint64_t initstate, uint64_t initseq) { seed(initstate, initseq); }
+
+	void seed(uint64_t initstate, uint64_t initseq)
+	{
+		state = 0;
+		inc = (initseq << 1) | 1;	// the increment selects the stream and must be odd
+		next_uint();
+		state += initstate;
+		next_uint();
+	}
+
+	uint32_t next_uint()
+	{
+		uint64_t oldstate = state;
+		state = oldstate * 6364136223846793005ULL + inc;
+		uint32_t xorshifted = static_cast<uint32_t>(((oldstate >> 18) ^ oldstate) >> 27);
+		uint32_t rot = static_cast<uint32_t>(oldstate >> 59);
+		return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+	}
+
+	double next_double()
+	{
+		// Returns a random real in [0,1).
+		return next_uint() * (1.0 / 4294967296.0);
+	}
+
+	// Derive the generator for one (stream, sample) pair of a render seed. The same triple
+	// always yields the same sequence, whichever thread asks for it and in whatever order.
+	static pcg32 for_sample(uint64_t seed, uint64_t stream, uint64_t sample)
+	{
+		uint64_t key = splitmix64(seed ^ splitmix64(stream));
+		return pcg32(splitmix64(key + sample), key);
+	}
+
+	static uint64_t splitmix64(uint64_t x)
+	{
+		x += 0x9e3779b97f4a7c15ULL;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		return x ^ (x >> 31);
+	}
+
+private:
+	uint64_t state;
+	uint64_t inc;
+};
+
+#endif
\ No newline at end of file
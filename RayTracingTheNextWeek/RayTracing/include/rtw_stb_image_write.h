@@ -0,0 +1,20 @@
+#ifndef RTWEEKEND_STB_IMAGE_WRITE_H
+#define RTWEEKEND_STB_IMAGE_WRITE_H
+
+// Disable pedantic warnings for this external library.
+#ifdef _MSC_VER
+	// Microsoft Visual C++ Compiler
+	#pragma warning(push, 0)
+#endif
+
+// Use the copy vendored with the M_RT projects rather than carrying a second one.
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "../../../M_RT/3rdParty/include/stb_image/stb_image_write.h"
+
+// Restore warning levels.
+#ifdef _MSC_VER
+	// Microsoft Visual C++ Compiler
+	#pragma warning(pop)
+#endif
+
+#endif
\ No newline at end of file
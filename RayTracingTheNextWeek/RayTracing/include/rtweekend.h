@@ -5,7 +5,8 @@
 #include <limits>
 #include <memory>
 #include <cstdlib>
-#include <random>
+
+#include "rng.h"
 
 // Usings
 
@@ -13,6 +14,15 @@ using std::shared_ptr;
 using std::make_shared;
 using std::sqrt;
 
+// Scalar type of all geometry (vec3, ray, aabb, hit_record, primitives). Build with
+// RT_USE_FLOAT to trade precision for half the memory traffic, and with RT_USE_SIMD to
+// back vec3 with a 4-wide SSE (float) or AVX (double) layout.
+#if defined(RT_USE_FLOAT)
+using real = float;
+#else
+using real = double;
+#endif
+
 // Constants
 
 const double infinity = std::numeric_limits<double>::infinity();
@@ -26,26 +36,39 @@ inline double degrees_to_radians(double degrees)
 }
 
 
-inline double random_double() 
+// Every thread draws from its own generator, so workers never contend on (or race with)
+// a shared state. Scene construction uses one stream of the seed; while rendering, each
+// sample of each pixel gets its own stream, so an image is bit-identical no matter how
+// many threads rendered it or in which order the tiles finished.
+inline pcg32& random_generator()
 {
-	// Returns a random real in [0,1).
-	return rand() / (RAND_MAX + 1.0);
+	thread_local pcg32 generator;
+	return generator;
 }
 
-inline double random_double(double min, double max) 
+const uint64_t scene_stream = ~0ULL;
+
+inline void seed_random(uint64_t seed)
 {
-	// Returns a random real in [min,max).
-	return min + (max - min) * random_double();
+	random_generator() = pcg32::for_sample(seed, scene_stream, 0);
+}
+
+inline void seed_random(uint64_t seed, uint64_t pixel, uint64_t sample)
+{
+	random_generator() = pcg32::for_sample(seed, pixel, sample);
 }
 
-/*
 inline double random_double()
 {
-	static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-	static std::mt19937 generator;
-	return distribution(generator);
+	// Returns a random real in [0,1).
+	return random_generator().next_double();
+}
+
+inline double random_double(double min, double max) 
+{
+	// Returns a random real in [min,max).
+	return min + (max - min) * random_double();
 }
-*/
 
 inline int random_int(int min, int max)
 {
@@ -0,0 +1,346 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+// Where the random numbers of a camera path come from. A sample of a pixel asks for its
+// dimensions in order, two at a time: the jitter in the pixel, the lens and shutter, then per
+// bounce the light, the point on it, the scattered direction and so on. Samplers other than
+// the independent one place the samples of a pixel (and of its neighbours) so they cover
+// each pair of dimensions evenly, which takes fewer samples to the same noise.
+//
+//   independent  the per-sample random stream, as random_double() draws it
+//   stratified   a jittered grid over each pair of dimensions, shuffled per pixel and pair
+//   sobol        the Sobol sequence, Owen scrambled per pixel and pair (Burley 2020)
+//   blue_noise   one Owen scrambled Sobol sequence for the whole image, whose consecutive
+//                runs go to the pixels in a shuffled Morton order (Ahmed and Wonka 2020), so
+//                neighbouring pixels' errors differ and the noise is spread as blue noise
+//
+// Only shading draws from the sampler. Hit tests (a constant_medium's free path) keep using
+// random_double(), since how often they run depends on the BVH.
+
+enum class sampler_type { independent, stratified, sobol, blue_noise };
+const int sampler_type_count = 4;
+const char* const sampler_type_names[sampler_type_count] = { "independent", "stratified", "sobol", "blue-noise" };
+
+struct sample_2d
+{
+	double u, v;	// each in [0, 1)
+};
+
+class sampler
+{
+public:
+	virtual ~sampler() {}
+
+	// Dimension pair d of sample index of the pixel. Samplers have no per-thread state, so
+	// one is shared by every thread.
+	virtual sample_2d get_2d(uint64_t pixel, uint32_t index, uint32_t dimension) const = 0;
+};
+
+// The generator matrices of the first two Sobol dimensions, from the table PathTraceToy's
+// pathTrace.glsl uses. Column j is the contribution of bit j of the index. Of that table's
+// eight dimensions only these two make a (0,2)-sequence, well spread in every power-of-two
+// count of samples (the shader's (6,7) pair puts 16 samples in just 4 of 16 cells), so
+// every pair of dimensions uses them under its own shuffle and scramble instead.
+const uint32_t sobol_matrices[2][32] = {
+	{ 0x80000000, 0x40000000, 0x20000000, 0x10000000, 0x08000000, 0x04000000, 0x02000000, 0x01000000,
+	  0x00800000, 0x00400000, 0x00200000, 0x00100000, 0x00080000, 0x00040000, 0x00020000, 0x00010000,
+	  0x00008000, 0x00004000, 0x00002000, 0x00001000, 0x00000800, 0x00000400, 0x00000200, 0x00000100,
+	  0x00000080, 0x00000040, 0x00000020, 0x00000010, 0x00000008, 0x00000004, 0x00000002, 0x00000001 },
+	{ 0x80000000, 0xc0000000, 0xa0000000, 0xf0000000, 0x88000000, 0xcc000000, 0xaa000000, 0xff000000,
+	  0x80800000, 0xc0c00000, 0xa0a00000, 0xf0f00000, 0x88880000, 0xcccc0000, 0xaaaa0000, 0xffff0000,
+	  0x80008000, 0xc000c000, 0xa000a000, 0xf000f000, 0x88008800, 0xcc00cc00, 0xaa00aa00, 0xff00ff00,
+	  0x80808080, 0xc0c0c0c0, 0xa0a0a0a0, 0xf0f0f0f0, 0x88888888, 0xcccccccc, 0xaaaaaaaa, 0xffffffff }
+};
+
+inline uint32_t reverse_bits(uint32_t x)
+{
+	x = (x << 16) | (x >> 16);
+	x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+	x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+	x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+	x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+	return x;
+}
+
+// The matrices' products with each byte of an index, so that a sample is four lookups
+// instead of a loop over up to 32 bits (scrambled indices use all of them). Kept bit
+// reversed, the order the scrambles work in.
+struct sobol_byte_tables
+{
+	uint32_t columns[2][4][256];
+
+	sobol_byte_tables()
+	{
+		for (int d = 0; d < 2; d++)
+		{
+			for (int b = 0; b < 4; b++)
+			{
+				for (int x = 0; x < 256; x++)
+				{
+					uint32_t v = 0;
+					for (int j = 0; j < 8; j++)
+						if (x & (1 << j))
+							v ^= sobol_matrices[d][8 * b + j];
+					columns[d][b][x] = reverse_bits(v);
+				}
+			}
+		}
+	}
+
+	static const sobol_byte_tables& get()
+	{
+		static const sobol_byte_tables tables;
+		return tables;
+	}
+};
+
+// Sample index of a Sobol dimension, with its bits reversed: bit 0 is the half of [0, 1).
+inline uint32_t reversed_sobol(int dimension, uint32_t index)
+{
+	const auto& c = sobol_byte_tables::get().columns[dimension];
+	return c[0][index & 0xff] ^ c[1][(index >> 8) & 0xff] ^ c[2][(index >> 16) & 0xff] ^ c[3][index >> 24];
+}
+
+// Owen scrambling of a bit reversed 32-bit fraction by a hash, after Laine and Karras: each
+// bit is flipped depending only on the bits below it (above it in the fraction), so the
+// points stay a net. Applied to an index it shuffles the order of the points while keeping
+// aligned power-of-two runs together.
+inline uint32_t reversed_owen_scramble(uint32_t x, uint32_t seed)
+{
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+
+inline uint32_t owen_scramble(uint32_t x, uint32_t seed)
+{
+	return reverse_bits(reversed_owen_scramble(reverse_bits(x), seed));
+}
+
+// A 32-bit hash of a few keys, for seeding the scrambles and the jitter.
+inline uint32_t sample_hash(uint64_t a, uint64_t b, uint64_t c = 0)
+{
+	return static_cast<uint32_t>(pcg32::splitmix64(a ^ pcg32::splitmix64(b * 0xd1342543de82ef95ULL + c)) >> 32);
+}
+
+inline double to_unit(uint32_t x)
+{
+	return x * (1.0 / 4294967296.0);
+}
+
+// spp jittered strata per pair of dimensions, in an nx * ny grid as near square as spp allows.
+// Sample index takes stratum permute(index), a different permutation for each pixel and pair,
+// so the pairs are not correlated. Samples past the grid (adaptive sampling, or a resumed
+// render taken higher, which keeps its grid) are independent.
+class stratified_sampler : public sampler
+{
+public:
+	stratified_sampler(uint64_t seed, int spp) : seed(seed)
+	{
+		spp = std::max(spp, 1);
+		nx = 1;
+		while ((nx + 1) * (nx + 1) <= static_cast<uint32_t>(spp))
+			nx++;
+		ny = spp / nx;
+	}
+
+	virtual sample_2d get_2d(uint64_t pixel, uint32_t index, uint32_t dimension) const override
+	{
+		auto key = sample_hash(seed, pixel, dimension);
+		uint32_t strata = nx * ny;
+		auto jitter_u = to_unit(sample_hash(key, index, 0));
+		auto jitter_v = to_unit(sample_hash(key, index, 1));
+		if (index >= strata)
+			return { jitter_u, jitter_v };
+
+		auto stratum = permute(index, strata, key);
+		return { (stratum % nx + jitter_u) / nx, (stratum / nx + jitter_v) / ny };
+	}
+
+private:
+	// Kensler's hashed permutation of [0, l): no table, any l.
+	static uint32_t permute(uint32_t i, uint32_t l, uint32_t p)
+	{
+		uint32_t w = l - 1;
+		w |= w >> 1;
+		w |= w >> 2;
+		w |= w >> 4;
+		w |= w >> 8;
+		w |= w >> 16;
+		do
+		{
+			i ^= p; i *= 0xe170893d;
+			i ^= p >> 16;
+			i ^= (i & w) >> 4;
+			i ^= p >> 8; i *= 0x0929eb3f;
+			i ^= p >> 23;
+			i ^= (i & w) >> 1; i *= 1 | p >> 27;
+			i *= 0x6935fa69;
+			i ^= (i & w) >> 11; i *= 0x74dcb303;
+			i ^= (i & w) >> 2; i *= 0x9e501cc3;
+			i ^= (i & w) >> 2; i *= 0xc860a3df;
+			i &= w;
+			i ^= i >> 5;
+		} while (i >= l);
+		return (i + p) % l;
+	}
+
+	uint64_t seed;
+	uint32_t nx, ny;
+};
+
+// Each pair of dimensions is the two Sobol dimensions, with its own scramble and its own
+// shuffle of the index per pixel, so the pairs are not correlated with each other (Burley's
+// padding of a 2D sequence).
+class sobol_sampler : public sampler
+{
+public:
+	explicit sobol_sampler(uint64_t seed) : seed(seed) {}
+
+	virtual sample_2d get_2d(uint64_t pixel, uint32_t index, uint32_t dimension) const override
+	{
+		return scrambled_2d(sample_hash(seed, pixel, dimension), index);
+	}
+
+	static sample_2d scrambled_2d(uint32_t key, uint32_t index)
+	{
+		auto i = owen_scramble(index, key);
+		auto u = reversed_owen_scramble(reversed_sobol(0, i), key * 0x9e3779b9u + 1);
+		auto v = reversed_owen_scramble(reversed_sobol(1, i), key * 0x85ebca6bu + 2);
+		return { to_unit(reverse_bits(u)), to_unit(reverse_bits(v)) };
+	}
+
+private:
+	uint64_t seed;
+};
+
+// The Sobol sampler's sequence, scrambled the same for every pixel. A pixel takes the run of
+// stride points at its Morton index after an Owen scramble of that index, which keeps the
+// quadtree of pixels together: neighbouring pixels take neighbouring runs, and a block of
+// 2^k x 2^k pixels covers each pair as well as one pixel taking all of their samples would.
+// The run index keeps its low 32 - stride bits, so pixels that share runs are far apart; a
+// pixel sampled past the stride (a resumed render taken higher) overlaps its neighbour's run.
+class blue_noise_sampler : public sampler
+{
+public:
+	blue_noise_sampler(uint64_t seed, int max_spp, int image_width) : seed(seed), image_width(image_width)
+	{
+		stride_bits = 0;
+		while ((1 << stride_bits) < max_spp && stride_bits < 16)
+			stride_bits++;
+	}
+
+	virtual sample_2d get_2d(uint64_t pixel, uint32_t index, uint32_t dimension) const override
+	{
+		auto key = sample_hash(seed, dimension);
+		auto x = static_cast<uint32_t>(pixel % image_width);
+		auto y = static_cast<uint32_t>(pixel / image_width);
+		auto order = owen_scramble(morton(x, y) << (32 - 2 * morton_bits), key ^ 0x5bd1e995u) >> (32 - 2 * morton_bits);
+		return sobol_sampler::scrambled_2d(key, (order << stride_bits) + index);
+	}
+
+private:
+	static const int morton_bits = 12;	// per axis; larger images wrap around
+
+	static uint32_t spread(uint32_t x)
+	{
+		x &= (1u << morton_bits) - 1;
+		x = (x | (x << 8)) & 0x00ff00ff;
+		x = (x | (x << 4)) & 0x0f0f0f0f;
+		x = (x | (x << 2)) & 0x33333333;
+		x = (x | (x << 1)) & 0x55555555;
+		return x;
+	}
+
+	static uint32_t morton(uint32_t x, uint32_t y) { return spread(x) | (spread(y) << 1); }
+
+	uint64_t seed;
+	int image_width;
+	int stride_bits;	// samples per pixel, rounded up to a power of two
+};
+
+// max_spp is the most samples any pixel will take, spp the usual number. The independent
+// sampler is null: random_double() itself, without a virtual call in front of it.
+inline std::shared_ptr<sampler> make_sampler(sampler_type type, uint64_t seed, int spp, int max_spp, int image_width)
+{
+	switch (type)
+	{
+	case sampler_type::stratified:	return std::make_shared<stratified_sampler>(seed, spp);
+	case sampler_type::sobol:		return std::make_shared<sobol_sampler>(seed);
+	case sampler_type::blue_noise:	return std::make_shared<blue_noise_sampler>(seed, max_spp, image_width);
+	default:						return nullptr;
+	}
+}
+
+inline bool parse_sampler_type(const char* name, sampler_type& type)
+{
+	for (int i = 0; i < sampler_type_count; i++)
+	{
+		if (!strcmp(name, sampler_type_names[i]))
+		{
+			type = static_cast<sampler_type>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+// The sample this thread is taking: its sampler, pixel and index, and how many dimension
+// pairs it has drawn. Set next to seed_random for every sample; without a sampler, draws
+// come from random_double().
+struct sample_context
+{
+	const sampler* source = nullptr;
+	uint64_t pixel = 0;
+	uint32_t index = 0;
+	uint32_t dimension = 0;
+};
+
+inline sample_context& current_sample()
+{
+	thread_local sample_context context;
+	return context;
+}
+
+inline void start_sample(const sampler* source, uint64_t pixel, uint32_t index)
+{
+	current_sample() = { source, pixel, index, 0 };
+}
+
+// The next pair of dimensions from the current sampler. Kept apart from next_2d so that
+// the common independent case stays small enough to inline.
+inline sample_2d next_sampler_2d()
+{
+	auto& c = current_sample();
+	return c.source->get_2d(c.pixel, c.index, c.dimension++);
+}
+
+// The next pair of dimensions of the current sample.
+inline sample_2d next_2d()
+{
+	if (current_sample().source)
+		return next_sampler_2d();
+	auto u = random_double();
+	return { u, random_double() };
+}
+
+// One dimension. From a sampler the other half of the pair goes unused, so dimensions stay
+// aligned.
+inline double next_1d()
+{
+	if (current_sample().source)
+		return next_sampler_2d().u;
+	return random_double();
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,361 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "rtweekend.h"
+
+#include "hittable_list.h"
+#include "sphere.h"
+#include "sphere_set.h"
+#include "material.h"
+#include "moving_sphere.h"
+#include "aarect.h"
+#include "box.h"
+#include "box_set.h"
+#include "constant_medium.h"
+#include "instance.h"
+#include "linear_bvh.h"
+
+#include <cstdlib>
+#include <string>
+
+hittable_list random_scene(scene_assets& assets)
+{
+	hittable_list world;
+	//auto ground_material = assets.materials.make<lambertian>(assets.solid(color(0.5, 0.5, 0.5)));
+	//world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
+	auto checker = assets.textures.make<checker_texture>(assets.solid(color(0.2, 0.3, 0.1)), assets.solid(color(0.9, 0.9, 0.9)));
+	world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, assets.materials.make<lambertian>(checker)));
+
+	sphere_set spheres;
+
+	for (int a = -11; a < 11; a++)
+	{
+		for (int b = -11; b < 11; b++)
+		{
+			auto choose_mat = random_double();
+			point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+
+			if ((center - point3(4, 0.2, 0)).length() > 0.9)
+			{
+				material_id sphere_material;
+
+				if (choose_mat < 0.8)
+				{
+					// diffuse
+					auto albedo = color::random() * color::random();
+					sphere_material = assets.materials.make<lambertian>(assets.solid(albedo));
+					auto center2 = center + vec3(0, random_double(0, .5), 0);
+					spheres.add(center, center2, 0.0, 1.0, 0.2, sphere_material);
+				}
+				else if (choose_mat < 0.95)
+				{
+					// metal
+					auto albedo = color::random(0.5, 1);
+					auto fuzz = random_double(0, 0.5);
+					sphere_material = assets.materials.make<metal>(albedo, fuzz);
+					spheres.add(center, 0.2, sphere_material);
+				}
+				else
+				{
+					// glass
+					sphere_material = assets.materials.make<dielectric>(1.5);
+					spheres.add(center, 0.2, sphere_material);
+				}
+			}
+		}
+	}
+
+	auto material1 = assets.materials.make<dielectric>(1.5);
+	spheres.add(point3(0, 1, 0), 1.0, material1);
+
+	auto material2 = assets.materials.make<lambertian>(assets.solid(color(0.4, 0.2, 0.1)));
+	spheres.add(point3(-4, 1, 0), 1.0, material2);
+
+	auto material3 = assets.materials.make<metal>(color(0.7, 0.6, 0.5), 0.0);
+	spheres.add(point3(4, 1, 0), 1.0, material3);
+
+	for (const auto& set : spheres.split())
+		world.add(set);
+
+	return world;
+}
+
+hittable_list two_spheres(scene_assets& assets) {
+	hittable_list objects;
+
+	auto checker = assets.textures.make<checker_texture>(assets.solid(color(0.2, 0.3, 0.1)), assets.solid(color(0.9, 0.9, 0.9)));
+
+	objects.add(make_shared<sphere>(point3(0, -10, 0), 10, assets.materials.make<lambertian>(checker)));
+	objects.add(make_shared<sphere>(point3(0, 10, 0), 10, assets.materials.make<lambertian>(checker)));
+
+	return objects;
+}
+
+hittable_list two_perlin_spheres(scene_assets& assets)
+{
+	hittable_list objects;
+
+	auto pertext = assets.textures.make<noise_texture>(4);
+	objects.add(make_shared<sphere>(point3(0, -1000, 0), 1000, assets.materials.make<lambertian>(pertext)));
+	objects.add(make_shared<sphere>(point3(0, 2, 0), 2, assets.materials.make<lambertian>(pertext)));
+	
+	return objects;
+}
+
+hittable_list earth(scene_assets& assets)
+{
+	auto earth_texture = assets.textures.make<image_texture>("earthmap.jpg");
+	auto earth_surface = assets.materials.make<lambertian>(earth_texture);
+	auto globe = make_shared<sphere>(point3(0, 0, 0), 2, earth_surface);
+	return hittable_list(globe);
+}
+
+hittable_list simple_light(scene_assets& assets)
+{
+	hittable_list objects;
+
+	auto pertext = assets.textures.make<noise_texture>(4);
+	objects.add(make_shared<sphere>(point3(0, -1000, 0), 1000, assets.materials.make<lambertian>(pertext)));
+	objects.add(make_shared<sphere>(point3(0, 2, 0), 2, assets.materials.make<lambertian>(pertext)));
+
+	auto difflight = assets.materials.make<diffuse_light>(assets.solid(color(4, 4, 4)));
+	objects.add(make_shared<xy_rect>(3, 5, 1, 3, -2, difflight));
+	objects.add(make_shared<sphere>(point3(0, 7, 0), 2, assets.materials.make<diffuse_light>(assets.solid(color(4, 4, 4)))));
+
+	return objects;
+}
+
+hittable_list cornell_box(scene_assets& assets)
+{
+	hittable_list objects;
+
+	auto red = assets.materials.make<lambertian>(assets.solid(color(.65, .05, .05)));
+	auto white = assets.materials.make<lambertian>(assets.solid(color(.73, .73, .73)));
+	auto green = assets.materials.make<lambertian>(assets.solid(color(.12, .45, .15)));
+	auto light = assets.materials.make<diffuse_light>(assets.solid(color(15, 15, 15)));
+
+	objects.add(make_shared<yz_rect>(0, 555, 0, 555, 555, green));
+	objects.add(make_shared<yz_rect>(0, 555, 0, 555, 0, red));
+	objects.add(make_shared<xz_rect>(213, 343, 227, 332, 554, light));
+	objects.add(make_shared<xz_rect>(0, 555, 0, 555, 0, white));
+	objects.add(make_shared<xz_rect>(0, 555, 0, 555, 555, white));
+	objects.add(make_shared<xy_rect>(0, 555, 0, 555, 555, white));
+
+	//objects.add(make_shared<box>(point3(130, 0, 65), point3(295, 165, 230), white));
+	//objects.add(make_shared<box>(point3(265, 0, 295), point3(430, 330, 460), white));
+	shared_ptr<hittable> box1 = make_shared<instance>(make_shared<box>(point3(0, 0, 0), point3(165, 330, 165), white),
+													  affine::translation(vec3(265, 0, 295)) * affine::rotation_y(15));
+	objects.add(box1);
+
+	shared_ptr<hittable> box2 = make_shared<instance>(make_shared<box>(point3(0, 0, 0), point3(165, 165, 165), white),
+													  affine::translation(vec3(130, 0, 65)) * affine::rotation_y(-18));
+	objects.add(box2);
+
+	return objects;
+}
+
+hittable_list cornell_smoke(scene_assets& assets)
+{
+	hittable_list objects;
+
+	auto red = assets.materials.make<lambertian>(assets.solid(color(.65, .05, .05)));
+	auto white = assets.materials.make<lambertian>(assets.solid(color(.73, .73, .73)));
+	auto green = assets.materials.make<lambertian>(assets.solid(color(.12, .45, .15)));
+	auto light = assets.materials.make<diffuse_light>(assets.solid(color(7, 7, 7)));
+
+	objects.add(make_shared<yz_rect>(0, 555, 0, 555, 555, green));
+	objects.add(make_shared<yz_rect>(0, 555, 0, 555, 0, red));
+	objects.add(make_shared<xz_rect>(113, 443, 127, 432, 554, light));
+	objects.add(make_shared<xz_rect>(0, 555, 0, 555, 555, white));
+	objects.add(make_shared<xz_rect>(0, 555, 0, 555, 0, white));
+	objects.add(make_shared<xy_rect>(0, 555, 0, 555, 555, white));
+
+	shared_ptr<hittable> box1 = make_shared<instance>(make_shared<box>(point3(0, 0, 0), point3(165, 330, 165), white),
+													  affine::translation(vec3(265, 0, 295)) * affine::rotation_y(15));
+
+	shared_ptr<hittable> box2 = make_shared<instance>(make_shared<box>(point3(0, 0, 0), point3(165, 165, 165), white),
+													  affine::translation(vec3(130, 0, 65)) * affine::rotation_y(-18));
+
+	objects.add(make_shared<constant_medium>(box1, 0.01, assets.materials.make<isotropic>(assets.solid(color(0, 0, 0)))));
+	objects.add(make_shared<constant_medium>(box2, 0.01, assets.materials.make<isotropic>(assets.solid(color(1, 1, 1)))));
+
+	return objects;
+}
+
+hittable_list final_scene(scene_assets& assets, const bvh_build_options& bvh_options)
+{
+	box_set ground_boxes;
+	auto ground = assets.materials.make<lambertian>(assets.solid(color(0.48, 0.83, 0.53)));
+
+	const int boxes_per_side = 20;
+	for (int i = 0; i < boxes_per_side; i++)
+	{
+		for (int j = 0; j < boxes_per_side; j++)
+		{
+			auto w = 100.0;
+			auto x0 = -1000.0 + i * w;
+			auto z0 = -1000.0 + j * w;
+			auto y0 = 0.0;
+			auto x1 = x0 + w;
+			auto y1 = random_double(1, 101);
+			auto z1 = z0 + w;
+
+			ground_boxes.add(point3(x0, y0, z0), point3(x1, y1, z1), ground);
+		}
+	}
+
+	hittable_list boxes1;
+	for (const auto& set : ground_boxes.split())
+		boxes1.add(set);
+
+	hittable_list objects;
+	objects.add(make_shared<linear_bvh>(boxes1, 0, 1, bvh_options));
+
+	auto light = assets.materials.make<diffuse_light>(assets.solid(color(7, 7, 7)));
+	objects.add(make_shared<xz_rect>(123, 423, 147, 412, 554, light));
+
+
+	auto center1 = point3(400, 400, 200);
+	auto center2 = center1 + vec3(30, 0, 0);
+	auto moving_sphere_material = assets.materials.make<lambertian>(assets.solid(color(0.7, 0.3, 0.1)));
+	objects.add(make_shared<moving_sphere>(center1, center2, 0, 1, 50, moving_sphere_material));
+
+	objects.add(make_shared<sphere>(point3(260, 150, 45), 50, assets.materials.make<dielectric>(1.5)));
+	objects.add(make_shared<sphere>(point3(0, 150, 145), 50, assets.materials.make<metal>(color(0.8, 0.8, 0.9), 1.0)));
+	
+	auto boundary = make_shared<sphere>(point3(360, 150, 145), 70, assets.materials.make<dielectric>(1.5));
+	objects.add(boundary);
+	objects.add(make_shared<constant_medium>(boundary, 0.2, assets.materials.make<isotropic>(assets.solid(color(0.2, 0.4, 0.9)))));
+	boundary = make_shared<sphere>(point3(0, 0, 0), 5000, assets.materials.make<dielectric>(1.5));
+	objects.add(make_shared<constant_medium>(boundary, .0001, assets.materials.make<isotropic>(assets.solid(color(1, 1, 1)))));
+
+	auto emat = assets.materials.make<lambertian>(assets.textures.make<image_texture>("earthmap.jpg"));
+	objects.add(make_shared<sphere>(point3(400, 200, 400), 100, emat));
+	auto pertext = assets.textures.make<noise_texture>(0.1);
+	objects.add(make_shared<sphere>(point3(220, 280, 300), 80, assets.materials.make<lambertian>(pertext)));
+
+	sphere_set spheres;
+	auto white = assets.materials.make<lambertian>(assets.solid(color(.73, .73, .73)));
+	int ns = 1000;
+	for (int j = 0; j < ns; j++)
+	{
+		spheres.add(point3::random(0, 165), 10, white);
+	}
+
+	hittable_list boxes2;
+	for (const auto& set : spheres.split())
+		boxes2.add(set);
+
+	objects.add(make_shared<instance>(make_shared<linear_bvh>(boxes2, 0.0, 1.0, bvh_options),
+									  affine::translation(vec3(-100, 270, 395)) * affine::rotation_y(15)));
+
+	return objects;
+}
+
+// A built-in scene: its objects and the camera and image settings it was made for.
+struct scene_setup
+{
+	hittable_list world;
+	color background = color(0, 0, 0);
+	point3 lookfrom;
+	point3 lookat;
+	real vfov = 40.0;
+	real aperture = 0.0;
+	real aspect_ratio = 16.0 / 9.0;
+	int image_width = 400;
+	int samples_per_pixel = 100;
+};
+
+// The built-in scenes, by number and name. 0 is not a scene.
+const int scene_count = 9;
+const char* const scene_names[scene_count] = {
+	"", "random_scene", "two_spheres", "two_perlin_spheres", "earth",
+	"simple_light", "cornell_box", "cornell_smoke", "final_scene"
+};
+
+// The number of the scene called name, which may also be the number itself; 0 if there
+// is no such scene.
+int find_scene(const std::string& name)
+{
+	for (int id = 1; id < scene_count; id++)
+		if (name == scene_names[id] || name == std::to_string(id))
+			return id;
+	return 0;
+}
+
+// Builds scene id, drawing its random numbers from the scene stream, with every BVH inside
+// it built with bvh_options.
+scene_setup make_scene(int id, scene_assets& assets, const bvh_build_options& bvh_options)
+{
+	scene_setup scene;
+	switch (id) {
+	case 1:
+		scene.world = random_scene(assets);
+		scene.background = color(0.70, 0.80, 1.00);
+		scene.lookfrom = point3(13, 2, 3);
+		scene.lookat = point3(0, 0, 0);
+		scene.vfov = 20.0;
+		scene.aperture = 0.1;
+		break;
+	case 2:
+		scene.world = two_spheres(assets);
+		scene.background = color(0.70, 0.80, 1.00);
+		scene.lookfrom = point3(13, 2, 3);
+		scene.lookat = point3(0, 0, 0);
+		scene.vfov = 20.0;
+		break;
+	case 3:
+		scene.world = two_perlin_spheres(assets);
+		scene.background = color(0.70, 0.80, 1.00);
+		scene.lookfrom = point3(13, 2, 3);
+		scene.lookat = point3(0, 0, 0);
+		scene.vfov = 20.0;
+		break;
+	case 4:
+		scene.world = earth(assets);
+		scene.background = color(0.70, 0.80, 1.00);
+		scene.lookfrom = point3(13, 2, 3);
+		scene.lookat = point3(0, 0, 0);
+		scene.vfov = 20.0;
+		break;
+	case 5:
+		scene.world = simple_light(assets);
+		scene.samples_per_pixel = 400;
+		scene.background = color(0.0, 0.0, 0.0);
+		scene.lookfrom = point3(26, 3, 6);
+		scene.lookat = point3(0, 2, 0);
+		scene.vfov = 20.0;
+		break;
+	case 6:
+		scene.world = cornell_box(assets);
+		scene.aspect_ratio = 1.0;
+		scene.image_width = 600;
+		scene.samples_per_pixel = 200;
+		scene.background = color(0, 0, 0);
+		scene.lookfrom = point3(278, 278, -800);
+		scene.lookat = point3(278, 278, 0);
+		scene.vfov = 40.0;
+		break;
+	case 7:
+		scene.world = cornell_smoke(assets);
+		scene.aspect_ratio = 1.0;
+		scene.image_width = 600;
+		scene.samples_per_pixel = 200;
+		scene.lookfrom = point3(278, 278, -800);
+		scene.lookat = point3(278, 278, 0);
+		scene.vfov = 40.0;
+		break;
+	case 8:
+		scene.world = final_scene(assets, bvh_options);
+		scene.aspect_ratio = 1.0;
+		scene.image_width = 800;
+		scene.samples_per_pixel = 10000;
+		scene.lookfrom = point3(478, 278, -600);
+		scene.lookat = point3(278, 278, 0);
+		scene.vfov = 40.0;
+		break;
+	}
+	return scene;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,64 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <immintrin.h>
+
+// The float lanes used by ray packets and by the SoA primitives: 8 wide with AVX, 4 wide
+// (SSE) otherwise. Comparisons return a bit mask with one bit per lane.
+
+#if defined(__AVX__)
+const int packet_width = 8;
+typedef __m256 packet_float;
+
+inline packet_float packet_load(const float* p) { return _mm256_load_ps(p); }
+inline packet_float packet_loadu(const float* p) { return _mm256_loadu_ps(p); }
+inline void packet_store(float* p, packet_float a) { _mm256_store_ps(p, a); }
+inline packet_float packet_set1(float x) { return _mm256_set1_ps(x); }
+inline packet_float packet_add(packet_float a, packet_float b) { return _mm256_add_ps(a, b); }
+inline packet_float packet_sub(packet_float a, packet_float b) { return _mm256_sub_ps(a, b); }
+inline packet_float packet_mul(packet_float a, packet_float b) { return _mm256_mul_ps(a, b); }
+inline packet_float packet_min(packet_float a, packet_float b) { return _mm256_min_ps(a, b); }
+inline packet_float packet_max(packet_float a, packet_float b) { return _mm256_max_ps(a, b); }
+inline int packet_less_mask(packet_float a, packet_float b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+// Lane l of x, y and z gets the first three floats of rows[index[l]].
+inline void packet_gather_xyz(const float (*rows)[4], const int* index, packet_float& x, packet_float& y, packet_float& z)
+{
+	__m128 lo[4], hi[4];
+	for (int l = 0; l < 4; l++)
+	{
+		lo[l] = _mm_load_ps(rows[index[l]]);
+		hi[l] = _mm_load_ps(rows[index[l + 4]]);
+	}
+	_MM_TRANSPOSE4_PS(lo[0], lo[1], lo[2], lo[3]);
+	_MM_TRANSPOSE4_PS(hi[0], hi[1], hi[2], hi[3]);
+	x = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[0]), hi[0], 1);
+	y = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[1]), hi[1], 1);
+	z = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[2]), hi[2], 1);
+}
+#else
+const int packet_width = 4;
+typedef __m128 packet_float;
+
+inline packet_float packet_load(const float* p) { return _mm_load_ps(p); }
+inline packet_float packet_loadu(const float* p) { return _mm_loadu_ps(p); }
+inline void packet_store(float* p, packet_float a) { _mm_store_ps(p, a); }
+inline packet_float packet_set1(float x) { return _mm_set1_ps(x); }
+inline packet_float packet_add(packet_float a, packet_float b) { return _mm_add_ps(a, b); }
+inline packet_float packet_sub(packet_float a, packet_float b) { return _mm_sub_ps(a, b); }
+inline packet_float packet_mul(packet_float a, packet_float b) { return _mm_mul_ps(a, b); }
+inline packet_float packet_min(packet_float a, packet_float b) { return _mm_min_ps(a, b); }
+inline packet_float packet_max(packet_float a, packet_float b) { return _mm_max_ps(a, b); }
+inline int packet_less_mask(packet_float a, packet_float b) { return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+inline void packet_gather_xyz(const float (*rows)[4], const int* index, packet_float& x, packet_float& y, packet_float& z)
+{
+	__m128 r[4];
+	for (int l = 0; l < 4; l++)
+		r[l] = _mm_load_ps(rows[index[l]]);
+	_MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+	x = r[0];
+	y = r[1];
+	z = r[2];
+}
+#endif
+
+#endif
\ No newline at end of file
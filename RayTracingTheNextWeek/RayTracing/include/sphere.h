@@ -8,16 +8,18 @@ class sphere : public hittable
 {
 public :
 	sphere() {}
-	sphere(point3 cen, double r, shared_ptr<material> m) : center(cen), radius(r), mat_ptr(m) {};
+	sphere(point3 cen, real r, material_id m) : center(cen), radius(r), mat(m) {};
 
-	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
-	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override;
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(real time0, real time1, aabb& output_box) const override;
+	virtual bool convex() const override { return true; }
+	virtual bool hit_interval(const ray& r, real& t_enter, real& t_exit) const override;
 public:
 	point3 center;
-	double radius;
-	shared_ptr<material> mat_ptr;
-private:
-	static void get_sphere_uv(const point3& p, double& u, double& v) {
+	real radius;
+	material_id mat;
+
+	static void get_sphere_uv(const point3& p, real& u, real& v) {
 		// p: a given point on the sphere of radius one, centered at the origin.
 		// u: returned value [0,1] of angle around the Y axis from X=-1.
 		// v: returned value [0,1] of angle from Y=-1 to Y=+1.
@@ -33,7 +35,7 @@ private:
 	}
 };
 
-bool sphere::hit(const ray& r, double t_min, double t_max, hit_record& rec) const
+bool sphere::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
 {
 	vec3 oc = r.origin() - center;
 	auto a = r.direction().length_squared();
@@ -57,12 +59,28 @@ bool sphere::hit(const ray& r, double t_min, double t_max, hit_record& rec) cons
 	vec3 outward_normal = (rec.p - center) / radius;
 	rec.set_face_normal(r, outward_normal);
 	get_sphere_uv(outward_normal, rec.u, rec.v);
-	rec.mat_ptr = mat_ptr;
+	rec.mat_id = mat;
+
+	return true;
+}
+
+bool sphere::hit_interval(const ray& r, real& t_enter, real& t_exit) const
+{
+	vec3 oc = r.origin() - center;
+	auto a = r.direction().length_squared();
+	auto half_b = dot(oc, r.direction());
+	auto c = oc.length_squared() - radius * radius;
+
+	auto discriminant = half_b * half_b - a * c;
+	if (discriminant < 0) return false;
+	auto sqrtd = sqrt(discriminant);
 
+	t_enter = (-half_b - sqrtd) / a;
+	t_exit = (-half_b + sqrtd) / a;
 	return true;
 }
 
-bool sphere::bounding_box(double time0, double time1, aabb& output_box) const
+bool sphere::bounding_box(real time0, real time1, aabb& output_box) const
 {
 	output_box = aabb(center - vec3(radius, radius, radius), center + vec3(radius, radius, radius));
 	return true;
@@ -0,0 +1,288 @@
+#ifndef SPHERE_SET_H
+#define SPHERE_SET_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "aabb.h"
+#include "bvh_builder.h"
+#include "simd.h"
+#include "sphere.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Many spheres behind one hittable, stored as structure of arrays so that a ray is tested
+// against packet_width spheres per instruction. The wide test runs in float and only rejects
+// spheres the ray surely misses (it is padded for rounding); the survivors are intersected
+// with the same arithmetic as sphere and moving_sphere, so hits match theirs exactly.
+//
+// A set is meant to be a BVH leaf: collect the scene's spheres into one set and add the
+// pieces returned by split() to the world.
+class sphere_set : public hittable
+{
+public:
+	static const size_t default_split_size = 8;	// one AVX or two SSE iterations
+
+	sphere_set() {}
+
+	void add(const point3& center, real radius, material_id m)
+	{
+		add(center, center, 0, 1, radius, m);
+	}
+
+	void add(const point3& center0, const point3& center1, real time0, real time1, real radius, material_id m);
+
+	size_t size() const { return spheres.size(); }
+
+	// Spatially compact sets of at most max_size spheres each, cut with the same binned SAH
+	// the BVHs use.
+	std::vector<shared_ptr<hittable> > split(size_t max_size = default_split_size) const;
+
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(real time0, real time1, aabb& output_box) const override;
+	virtual bool motion_bounds(real time0, real time1, aabb& start, aabb& end) const override;
+
+private:
+	struct sphere_data
+	{
+		point3 center0, center1;
+		real time0, time1;
+		real radius;
+		material_id material;
+	};
+
+	point3 center(const sphere_data& s, real time) const
+	{
+		return s.center0 + ((time - s.time0) / (s.time1 - s.time0)) * (s.center1 - s.center0);
+	}
+
+	bool hit_sphere(const sphere_data& s, const ray& r, real t_min, real t_max, hit_record& rec) const;
+	void add_data(const sphere_data& s);
+	void split(std::vector<bvh_build_prim>& prims, size_t start, size_t end, const bvh_build_options& options,
+			   std::vector<shared_ptr<hittable> >& out) const;
+
+private:
+	std::vector<sphere_data> spheres;
+
+	// Float copies for the wide test, padded to a whole number of lanes. The centre at time
+	// t is base + t * velocity. Padding lanes have a negative squared radius.
+	std::vector<float> base[3];
+	std::vector<float> velocity[3];
+	std::vector<float> radius;
+	std::vector<float> radius_squared;
+};
+
+void sphere_set::add(const point3& center0, const point3& center1, real time0, real time1, real radius,
+					 material_id m)
+{
+	sphere_data s;
+	s.center0 = center0;
+	s.center1 = center1;
+	s.time0 = time0;
+	s.time1 = time1;
+	s.radius = radius;
+	s.material = m;
+	add_data(s);
+}
+
+void sphere_set::add_data(const sphere_data& s)
+{
+	// Drop the padding of the last group, append, then pad again.
+	auto n = spheres.size();
+	for (int a = 0; a < 3; a++)
+	{
+		base[a].resize(n);
+		velocity[a].resize(n);
+	}
+	radius.resize(n);
+	radius_squared.resize(n);
+
+	auto v = (s.center1 - s.center0) / (s.time1 - s.time0);
+	auto b = s.center0 - s.time0 * v;
+	for (int a = 0; a < 3; a++)
+	{
+		base[a].push_back(static_cast<float>(b[a]));
+		velocity[a].push_back(static_cast<float>(v[a]));
+	}
+	radius.push_back(static_cast<float>(s.radius));
+	radius_squared.push_back(static_cast<float>(s.radius * s.radius));
+	spheres.push_back(s);
+
+	auto padded = (spheres.size() + packet_width - 1) / packet_width * packet_width;
+	for (int a = 0; a < 3; a++)
+	{
+		base[a].resize(padded, 0.0f);
+		velocity[a].resize(padded, 0.0f);
+	}
+	radius.resize(padded, 0.0f);
+	radius_squared.resize(padded, -1.0f);
+}
+
+std::vector<shared_ptr<hittable> > sphere_set::split(size_t max_size) const
+{
+	std::vector<bvh_build_prim> prims(spheres.size());
+	for (size_t i = 0; i < spheres.size(); i++)
+	{
+		const auto& s = spheres[i];
+		vec3 r(s.radius, s.radius, s.radius);
+		prims[i].box = surrounding_box(aabb(s.center0 - r, s.center0 + r), aabb(s.center1 - r, s.center1 + r));
+		prims[i].centroid = 0.5 * (prims[i].box.min() + prims[i].box.max());
+		prims[i].index = static_cast<uint32_t>(i);
+	}
+
+	bvh_build_options options;
+	options.max_leaf_size = static_cast<int>(std::max<size_t>(max_size, 1));
+
+	std::vector<shared_ptr<hittable> > out;
+	if (!prims.empty())
+		split(prims, 0, prims.size(), options, out);
+	return out;
+}
+
+void sphere_set::split(std::vector<bvh_build_prim>& prims, size_t start, size_t end, const bvh_build_options& options,
+					   std::vector<shared_ptr<hittable> >& out) const
+{
+	if (end - start <= static_cast<size_t>(options.max_leaf_size))
+	{
+		auto set = make_shared<sphere_set>();
+		for (size_t i = start; i < end; i++)
+			set->add_data(spheres[prims[i].index]);
+		out.push_back(set);
+		return;
+	}
+
+	int axis;
+	auto mid = sah_split(prims, start, end, range_bounds(prims, start, end), options, axis);
+	split(prims, start, mid, options, out);
+	split(prims, mid, end, options, out);
+}
+
+bool sphere_set::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+	const auto& origin = r.origin();
+	const auto& direction = r.direction();
+	const auto length_squared = direction.length_squared();
+
+	const packet_float o[3] = {
+		packet_set1(static_cast<float>(origin.x())),
+		packet_set1(static_cast<float>(origin.y())),
+		packet_set1(static_cast<float>(origin.z())) };
+	const packet_float d[3] = {
+		packet_set1(static_cast<float>(direction.x())),
+		packet_set1(static_cast<float>(direction.y())),
+		packet_set1(static_cast<float>(direction.z())) };
+	const packet_float time = packet_set1(static_cast<float>(r.time()));
+	const packet_float inv_a = packet_set1(static_cast<float>(1 / length_squared));
+	const packet_float inv_length = packet_set1(static_cast<float>(1 / sqrt(length_squared)));
+	const packet_float lane_t_min = packet_set1(static_cast<float>(t_min));
+	const packet_float zero = packet_set1(0.0f);
+	const packet_float slack = packet_set1(1.001f);
+	const packet_float t_slack = packet_set1(1e-5f);
+
+	bool hit_anything = false;
+	for (size_t g = 0; g < spheres.size(); g += packet_width)
+	{
+		// tc is the ray parameter of the point closest to the centre and dist2 the squared
+		// distance from the centre to the ray. The ray can only hit the sphere if
+		// dist2 <= radius^2, and then only within radius / |d| of tc.
+		packet_float oc[3];
+		for (int a = 0; a < 3; a++)
+			oc[a] = packet_sub(packet_add(packet_loadu(&base[a][g]), packet_mul(time, packet_loadu(&velocity[a][g]))), o[a]);
+
+		auto tc = packet_mul(packet_add(packet_add(packet_mul(oc[0], d[0]), packet_mul(oc[1], d[1])), packet_mul(oc[2], d[2])), inv_a);
+		packet_float dist2 = zero;
+		for (int a = 0; a < 3; a++)
+		{
+			auto p = packet_sub(oc[a], packet_mul(tc, d[a]));
+			dist2 = packet_add(dist2, packet_mul(p, p));
+		}
+
+		auto abs_tc = packet_max(tc, packet_sub(zero, tc));
+		auto reach = packet_add(packet_mul(packet_mul(packet_loadu(&radius[g]), inv_length), slack), packet_mul(abs_tc, t_slack));
+		auto lane_t_max = packet_set1(static_cast<float>(t_max));
+
+		int lanes = packet_less_mask(dist2, packet_mul(packet_loadu(&radius_squared[g]), slack))
+				  & packet_less_mask(lane_t_min, packet_add(tc, reach))
+				  & packet_less_mask(packet_sub(tc, reach), lane_t_max);
+
+		for (int k = 0; lanes; k++, lanes >>= 1)
+		{
+			if ((lanes & 1) && hit_sphere(spheres[g + k], r, t_min, t_max, rec))
+			{
+				hit_anything = true;
+				t_max = rec.t;
+			}
+		}
+	}
+
+	return hit_anything;
+}
+
+bool sphere_set::hit_sphere(const sphere_data& s, const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+	auto c = center(s, r.time());
+	vec3 oc = r.origin() - c;
+	auto a = r.direction().length_squared();
+	auto half_b = dot(oc, r.direction());
+	auto cc = oc.length_squared() - s.radius * s.radius;
+
+	auto discriminant = half_b * half_b - a * cc;
+	if (discriminant < 0) return false;
+	auto sqrtd = sqrt(discriminant);
+
+	auto root = (-half_b - sqrtd) / a;
+	if (root < t_min || root > t_max)
+	{
+		root = (-half_b + sqrtd) / a;
+		if (root < t_min || root > t_max)
+			return false;
+	}
+
+	rec.t = root;
+	rec.p = r.at(rec.t);
+	vec3 outward_normal = (rec.p - c) / s.radius;
+	rec.set_face_normal(r, outward_normal);
+	sphere::get_sphere_uv(outward_normal, rec.u, rec.v);
+	rec.mat_id = s.material;
+
+	return true;
+}
+
+bool sphere_set::bounding_box(real time0, real time1, aabb& output_box) const
+{
+	if (spheres.empty())
+		return false;
+
+	for (size_t i = 0; i < spheres.size(); i++)
+	{
+		const auto& s = spheres[i];
+		vec3 r(s.radius, s.radius, s.radius);
+		aabb box = surrounding_box(aabb(center(s, time0) - r, center(s, time0) + r),
+								   aabb(center(s, time1) - r, center(s, time1) + r));
+		output_box = i ? surrounding_box(output_box, box) : box;
+	}
+	return true;
+}
+
+bool sphere_set::motion_bounds(real time0, real time1, aabb& start, aabb& end) const
+{
+	// Every sphere moves linearly; see hittable_list::motion_bounds for why the unions of the
+	// end boxes hold the set in between.
+	if (spheres.empty())
+		return false;
+
+	for (size_t i = 0; i < spheres.size(); i++)
+	{
+		const auto& s = spheres[i];
+		vec3 r(s.radius, s.radius, s.radius);
+		aabb box0(center(s, time0) - r, center(s, time0) + r);
+		aabb box1(center(s, time1) - r, center(s, time1) + r);
+		start = i ? surrounding_box(start, box0) : box0;
+		end = i ? surrounding_box(end, box1) : box1;
+	}
+	return true;
+}
+
+#endif
\ No newline at end of file
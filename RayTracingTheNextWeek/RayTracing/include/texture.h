@@ -3,12 +3,41 @@
 
 #include "rtweekend.h"
 #include "perlin.h"
-#include "rtw_stb_image.h"
+#include "image_cache.h"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Index of a texture in the scene's texture_table.
+typedef uint32_t texture_id;
+
+class texture_table;
 
 class texture
 {
 public:
-	virtual color value(double u, double v, const point3& p) const = 0;
+	virtual ~texture() {}
+	virtual color value(real u, real v, const point3& p, const texture_table& textures) const = 0;
+};
+
+// The scene owns its textures; materials and composite textures refer to them by id.
+class texture_table
+{
+public:
+	template <typename T, typename... Args>
+	texture_id make(Args&&... args)
+	{
+		items.emplace_back(new T(std::forward<Args>(args)...));
+		return static_cast<texture_id>(items.size() - 1);
+	}
+
+	const texture& operator[](texture_id id) const { return *items[id]; }
+	size_t size() const { return items.size(); }
+
+private:
+	std::vector<std::unique_ptr<texture> > items;
 };
 
 class solid_color : public texture
@@ -17,9 +46,9 @@ public:
 	solid_color() {}
 	solid_color(color c) : color_value(c) {}
 
-	solid_color(double red, double green, double blue) : solid_color(color(red, green, blue)){}
+	solid_color(real red, real green, real blue) : solid_color(color(red, green, blue)){}
 
-	virtual color value(double u, double v, const point3& p) const override
+	virtual color value(real u, real v, const point3& p, const texture_table& textures) const override
 	{
 		return color_value;
 	}
@@ -32,91 +61,66 @@ class checker_texture : public texture {
 public:
     checker_texture() {}
 
-    checker_texture(shared_ptr<texture> _even, shared_ptr<texture> _odd)
+    checker_texture(texture_id _even, texture_id _odd)
         : even(_even), odd(_odd) {}
 
-    checker_texture(color c1, color c2)
-        : even(make_shared<solid_color>(c1)), odd(make_shared<solid_color>(c2)) {}
-
-    virtual color value(double u, double v, const point3& p) const override {
+    virtual color value(real u, real v, const point3& p, const texture_table& textures) const override {
         auto sines = sin(10 * p.x()) * sin(10 * p.y()) * sin(10 * p.z());
         if (sines < 0)
-            return odd->value(u, v, p);
+            return textures[odd].value(u, v, p, textures);
         else
-            return even->value(u, v, p);
+            return textures[even].value(u, v, p, textures);
     }
 
 public:
-    shared_ptr<texture> odd;
-    shared_ptr<texture> even;
+    texture_id odd;
+    texture_id even;
 };
 
 class noise_texture : public texture
 {
 public:
     noise_texture() {}
-    noise_texture(double sc) : scale(sc) {}
-    virtual color value(double u, double v, const point3& p) const override
+    noise_texture(real sc, uint64_t seed = 0) : noise(seed), scale(sc) {}
+    virtual color value(real u, real v, const point3& p, const texture_table& textures) const override
     {
         //return color(1, 1, 1) * noise.noise(scale * p);
         //return color(1, 1, 1) * 0.5 * (1.0 + noise.noise(scale * p));   // [-1,1]Ϊ[0,1]
         //return color(1, 1, 1) * noise.turb(scale * p);                  // turbulence
-        return color(1, 1, 1) * 0.5 * (1 + sin(scale * p.z() + 10 * noise.turb(p)));    // λ
+        return color(1, 1, 1) * 0.5 * (1 + sin(scale * p.z() + 10 * noise.turb_fast(p)));    // λ
     }
 public:
     perlin noise;
-    double scale;       // scale the input point to make it vary more quickly
+    real scale;       // scale the input point to make it vary more quickly
 };
 
+// Samples a shared image from the image_cache. Textures made from the same file and format
+// hold the same decoded copy.
+enum class texture_filter { nearest, bilinear };
+
 class image_texture : public texture
 {
 public:
-    const static int bytes_per_pixel = 3;
+    image_texture() : filter(texture_filter::bilinear) {}
 
-    image_texture() : data(nullptr), width(0), height(0), bytes_per_scanline(0) {}
+    image_texture(image_handle image, texture_filter filter = texture_filter::bilinear)
+        : image(image), filter(filter) {}
 
-    image_texture(const char* filename)
-    {
-        auto components_per_pixel = bytes_per_pixel;
-        data = stbi_load(filename, &width, &height, &components_per_pixel, components_per_pixel);
-        if (!data)
-        {
-            std::cerr << "ERROR: Could not load texture image file '" << filename << "'.\n";
-            width = height = 0;
-        }
-        bytes_per_scanline = bytes_per_pixel * width;
-    }
-    ~image_texture()
-    {
-        delete data;
-    }
+    image_texture(const char* filename, texture_filter filter = texture_filter::bilinear)
+        : image(image_cache::global().load(filename)), filter(filter) {}
 
-    virtual color value(double u, double v, const point3& p) const override
+    virtual color value(real u, real v, const point3& p, const texture_table& textures) const override
     {
         // If we have no texture data, then return solid cyan as a debugging aid.
-        if (data == nullptr)
+        if (!image)
             return color(0, 1, 1);
 
-        // Clamp input texture coordinates to [0,1] x [1,0]
-        u = clamp(u, 0.0, 1.0);
-        v = 1 - clamp(v, 0.0, 1.0); // Flip V to image coordinates
-
-        auto i = static_cast<int>(u * width);
-        auto j = static_cast<int>(v * height);
-
-        // Clamp integer mapping, since actual coordinates should be less than 1.0
-        if (i >= width)  i = width - 1;
-        if (j >= height) j = height - 1;
-
-        const auto color_scale = 1.0 / 255.0;
-        auto pixel = data + j * bytes_per_scanline + i * bytes_per_pixel;
-
-        return color(color_scale * pixel[0], color_scale * pixel[1], color_scale * pixel[2]);
+        return filter == texture_filter::bilinear ? image->bilinear(u, v) : image->nearest(u, v);
     }
-private:
-    unsigned char* data;
-    int width, height;
-    int bytes_per_scanline;
+
+public:
+    image_handle image;
+    texture_filter filter;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,170 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small work-stealing thread pool. Every worker owns a task queue: it pops its own work
+// from the back and, once that runs dry, steals from the front of the other queues, so
+// uneven tiles (sky vs. fog vs. glass) still keep every core busy until the very end.
+class thread_pool
+{
+public:
+	// num_threads <= 0 selects one worker per hardware thread.
+	explicit thread_pool(int num_threads = 0);
+	~thread_pool();
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	void submit(std::function<void()> task);
+	void wait();	// blocks until every submitted task has finished
+
+	// Runs fn(i) for every i in [begin, end) on the workers and waits for all of them.
+	template <typename F>
+	void parallel_for(int begin, int end, const F& fn)
+	{
+		for (int i = begin; i < end; i++)
+			submit([&fn, i] { fn(i); });
+		wait();
+	}
+
+	int size() const { return static_cast<int>(workers.size()); }
+
+	static int default_thread_count()
+	{
+		auto n = static_cast<int>(std::thread::hardware_concurrency());
+		return n > 0 ? n : 1;
+	}
+
+private:
+	struct work_queue
+	{
+		std::mutex mutex;
+		std::deque<std::function<void()> > tasks;
+	};
+
+	void worker_loop(int index);
+	bool pop_local(int index, std::function<void()>& task);
+	bool steal(int thief, std::function<void()>& task);
+
+private:
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<work_queue> > queues;
+
+	std::mutex sleep_mutex;
+	std::condition_variable wake_cv;	// workers wait here for new tasks
+	std::condition_variable done_cv;	// wait() waits here for pending == 0
+
+	std::atomic<int> queued;	// tasks sitting in a queue
+	std::atomic<int> pending;	// tasks submitted but not yet finished
+	std::atomic<unsigned int> next_queue;
+	bool stopping;
+};
+
+thread_pool::thread_pool(int num_threads) : queued(0), pending(0), next_queue(0), stopping(false)
+{
+	if (num_threads <= 0)
+		num_threads = default_thread_count();
+
+	for (int i = 0; i < num_threads; i++)
+		queues.emplace_back(new work_queue);
+	for (int i = 0; i < num_threads; i++)
+		workers.emplace_back(&thread_pool::worker_loop, this, i);
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+	wake_cv.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+void thread_pool::submit(std::function<void()> task)
+{
+	// Deal tasks out round-robin; stealing evens out whatever imbalance is left.
+	auto index = next_queue++ % queues.size();
+	pending++;
+	queued++;
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+		queues[index]->tasks.push_back(std::move(task));
+	}
+
+	// Take the sleep lock so a worker cannot miss the wakeup between its check and its wait.
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+	}
+	wake_cv.notify_one();
+}
+
+void thread_pool::wait()
+{
+	std::unique_lock<std::mutex> lock(sleep_mutex);
+	done_cv.wait(lock, [this] { return pending.load() == 0; });
+}
+
+bool thread_pool::pop_local(int index, std::function<void()>& task)
+{
+	auto& q = *queues[index];
+	std::lock_guard<std::mutex> lock(q.mutex);
+	if (q.tasks.empty())
+		return false;
+	task = std::move(q.tasks.back());
+	q.tasks.pop_back();
+	return true;
+}
+
+bool thread_pool::steal(int thief, std::function<void()>& task)
+{
+	auto n = static_cast<int>(queues.size());
+	for (int k = 1; k < n; k++)
+	{
+		auto& q = *queues[(thief + k) % n];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (q.tasks.empty())
+			continue;
+		task = std::move(q.tasks.front());
+		q.tasks.pop_front();
+		return true;
+	}
+	return false;
+}
+
+void thread_pool::worker_loop(int index)
+{
+	std::function<void()> task;
+	while (true)
+	{
+		if (pop_local(index, task) || steal(index, task))
+		{
+			queued--;
+			task();
+			task = nullptr;
+
+			if (--pending == 0)
+			{
+				std::lock_guard<std::mutex> lock(sleep_mutex);
+				done_cv.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		wake_cv.wait(lock, [this] { return stopping || queued.load() > 0; });
+		if (stopping && queued.load() == 0)
+			return;
+	}
+}
+
+#endif
\ No newline at end of file
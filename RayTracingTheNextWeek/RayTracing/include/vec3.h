@@ -4,22 +4,43 @@
 #include <cmath>
 #include <iostream>
 
+#if defined(RT_USE_SIMD)
+#include <immintrin.h>
+#endif
+
 using std::sqrt;
 
-class vec3 {
+// Number of stored components. With RT_USE_SIMD a vector is padded to a full SSE (float)
+// or AVX (double) register, and the fourth lane is kept at zero by every operation.
+template <typename T> struct vec3_lanes { static const int value = 3; };
+#if defined(RT_USE_SIMD)
+template <> struct vec3_lanes<float> { static const int value = 4; };
+#if defined(__AVX__)
+template <> struct vec3_lanes<double> { static const int value = 4; };
+#endif
+#endif
+
+// Keeps a scalar argument out of template argument deduction, so 2.0 * v works for a
+// float vector as well.
+template <typename T> struct scalar_of { typedef T type; };
+
+template <typename T>
+class vec3_t {
 public:
-	vec3() : e{0, 0, 0} {}
-	vec3(double e0, double e1, double e2) : e{e0, e1, e2}{}
+	typedef T scalar;
+
+	vec3_t() : e{0, 0, 0} {}
+	vec3_t(T e0, T e1, T e2) : e{e0, e1, e2}{}
 
-	double x() const { return e[0]; }
-	double y() const { return e[1]; }
-	double z() const { return e[2]; }
+	T x() const { return e[0]; }
+	T y() const { return e[1]; }
+	T z() const { return e[2]; }
 
-	vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-	double operator[](int i) const { return e[i]; }
-	double& operator[](int i) { return e[i]; }
+	vec3_t operator-() const { return vec3_t(-e[0], -e[1], -e[2]); }
+	T operator[](int i) const { return e[i]; }
+	T& operator[](int i) { return e[i]; }
 
-	vec3& operator+=(const vec3& v)
+	vec3_t& operator+=(const vec3_t& v)
 	{
 		e[0] += v.e[0];
 		e[1] += v.e[1];
@@ -27,7 +48,7 @@ public:
 		return *this;
 	}
 
-	vec3& operator*=(const double t)
+	vec3_t& operator*=(const T t)
 	{
 		e[0] *= t;
 		e[1] *= t;
@@ -35,29 +56,29 @@ public:
 		return *this;
 	}
 
-	vec3& operator/=(const double t)
+	vec3_t& operator/=(const T t)
 	{
 		return *this *= 1 / t;
 	}
 
-	double length() const
+	T length() const
 	{
 		return sqrt(length_squared());
 	}
 
-	double length_squared() const
+	T length_squared() const
 	{
 		return e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
 	}
 
-	inline static vec3 random() 
+	inline static vec3_t random()
 	{
-		return vec3(random_double(), random_double(), random_double());
+		return vec3_t(random_double(), random_double(), random_double());
 	}
 
-	inline static vec3 random(double min, double max) 
+	inline static vec3_t random(double min, double max)
 	{
-		return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
+		return vec3_t(random_double(min, max), random_double(min, max), random_double(min, max));
 	}
 
 	bool near_zero() const
@@ -67,82 +88,208 @@ public:
 	}
 
 public:
-	double e[3];
+	T e[vec3_lanes<T>::value];
 };
 
 // type aliases for vec3
+using vec3   = vec3_t<real>;
 using point3 = vec3;		// 3D point
 using color  = vec3;		// RGB color
 
 // vec3 Utility Funcitions
 
-inline std::ostream& operator<<(std::ostream& out, const vec3& v)
+template <typename T>
+inline std::ostream& operator<<(std::ostream& out, const vec3_t<T>& v)
 {
 	return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
-inline vec3 operator+(const vec3& u, const vec3& v)
+template <typename T>
+inline vec3_t<T> operator+(const vec3_t<T>& u, const vec3_t<T>& v)
 {
-	return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+	return vec3_t<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
 }
 
-inline vec3 operator-(const vec3& u, const vec3& v)
+template <typename T>
+inline vec3_t<T> operator-(const vec3_t<T>& u, const vec3_t<T>& v)
 {
-	return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+	return vec3_t<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
 }
 
-inline vec3 operator*(const vec3& u, const vec3& v)
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T>& u, const vec3_t<T>& v)
 {
-	return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+	return vec3_t<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
-inline vec3 operator*(double t, const vec3& v)
+template <typename T>
+inline vec3_t<T> operator*(typename scalar_of<T>::type t, const vec3_t<T>& v)
 {
-	return vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
+	return vec3_t<T>(t * v.e[0], t * v.e[1], t * v.e[2]);
 }
 
-inline vec3 operator*(const vec3& v, double t)
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T>& v, typename scalar_of<T>::type t)
 {
 	return t * v;
 }
 
-inline vec3 operator/(const vec3& v, double t)
+template <typename T>
+inline vec3_t<T> operator/(const vec3_t<T>& v, typename scalar_of<T>::type t)
 {
 	return (1 / t) * v;
 }
 
-inline double dot(const vec3& u, const vec3& v)
+template <typename T>
+inline T dot(const vec3_t<T>& u, const vec3_t<T>& v)
 {
 	return u.e[0] * v.e[0]
 		 + u.e[1] * v.e[1]
 		 + u.e[2] * v.e[2];
 }
 
-inline vec3 cross(const vec3& u, const vec3& v)
+template <typename T>
+inline vec3_t<T> cross(const vec3_t<T>& u, const vec3_t<T>& v)
 {
-	return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
-				u.e[2] * v.e[0] - u.e[0] * v.e[2],
-				u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+	return vec3_t<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+					 u.e[2] * v.e[0] - u.e[0] * v.e[2],
+					 u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
 
-inline vec3 unit_vector(vec3 v)
+template <typename T>
+inline vec3_t<T> unit_vector(vec3_t<T> v)
 {
 	return v / v.length();
 }
 
-inline vec3 random_in_unit_sphere()
+#if defined(RT_USE_SIMD)
+// 4-wide overloads of the hot operations. Being non-templates they win overload resolution
+// over the scalar versions above. Unaligned loads keep them safe for vectors stored in
+// containers that do not honour over-alignment.
+
+inline __m128 vec3_load(const vec3_t<float>& v) { return _mm_loadu_ps(v.e); }
+inline vec3_t<float> vec3_store(__m128 m) { vec3_t<float> r; _mm_storeu_ps(r.e, m); return r; }
+
+inline vec3_t<float> operator+(const vec3_t<float>& u, const vec3_t<float>& v) { return vec3_store(_mm_add_ps(vec3_load(u), vec3_load(v))); }
+inline vec3_t<float> operator-(const vec3_t<float>& u, const vec3_t<float>& v) { return vec3_store(_mm_sub_ps(vec3_load(u), vec3_load(v))); }
+inline vec3_t<float> operator*(const vec3_t<float>& u, const vec3_t<float>& v) { return vec3_store(_mm_mul_ps(vec3_load(u), vec3_load(v))); }
+inline vec3_t<float> operator*(float t, const vec3_t<float>& v) { return vec3_store(_mm_mul_ps(_mm_set1_ps(t), vec3_load(v))); }
+inline vec3_t<float> operator*(const vec3_t<float>& v, float t) { return t * v; }
+
+inline float dot(const vec3_t<float>& u, const vec3_t<float>& v)
+{
+	__m128 m = _mm_mul_ps(vec3_load(u), vec3_load(v));
+	__m128 shuf = _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 sums = _mm_add_ps(m, shuf);
+	shuf = _mm_movehl_ps(shuf, sums);
+	return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+
+inline vec3_t<float> cross(const vec3_t<float>& u, const vec3_t<float>& v)
+{
+	__m128 a = vec3_load(u);
+	__m128 b = vec3_load(v);
+	__m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+	return vec3_store(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)));
+}
+
+inline vec3_t<float> unit_vector(vec3_t<float> v)
+{
+	__m128 m = vec3_load(v);
+	return vec3_store(_mm_div_ps(m, _mm_set1_ps(sqrt(dot(v, v)))));
+}
+
+#if defined(__AVX__)
+inline __m256d vec3_load(const vec3_t<double>& v) { return _mm256_loadu_pd(v.e); }
+inline vec3_t<double> vec3_store(__m256d m) { vec3_t<double> r; _mm256_storeu_pd(r.e, m); return r; }
+
+inline vec3_t<double> operator+(const vec3_t<double>& u, const vec3_t<double>& v) { return vec3_store(_mm256_add_pd(vec3_load(u), vec3_load(v))); }
+inline vec3_t<double> operator-(const vec3_t<double>& u, const vec3_t<double>& v) { return vec3_store(_mm256_sub_pd(vec3_load(u), vec3_load(v))); }
+inline vec3_t<double> operator*(const vec3_t<double>& u, const vec3_t<double>& v) { return vec3_store(_mm256_mul_pd(vec3_load(u), vec3_load(v))); }
+inline vec3_t<double> operator*(double t, const vec3_t<double>& v) { return vec3_store(_mm256_mul_pd(_mm256_set1_pd(t), vec3_load(v))); }
+inline vec3_t<double> operator*(const vec3_t<double>& v, double t) { return t * v; }
+
+inline double dot(const vec3_t<double>& u, const vec3_t<double>& v)
 {
-	while (true)
+	__m256d m = _mm256_mul_pd(vec3_load(u), vec3_load(v));
+	__m128d s = _mm_add_pd(_mm256_castpd256_pd128(m), _mm256_extractf128_pd(m, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+#if defined(__AVX2__)
+inline vec3_t<double> cross(const vec3_t<double>& u, const vec3_t<double>& v)
+{
+	__m256d a = vec3_load(u);
+	__m256d b = vec3_load(v);
+	__m256d a_yzx = _mm256_permute4x64_pd(a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m256d b_yzx = _mm256_permute4x64_pd(b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m256d c = _mm256_sub_pd(_mm256_mul_pd(a, b_yzx), _mm256_mul_pd(a_yzx, b));
+	return vec3_store(_mm256_permute4x64_pd(c, _MM_SHUFFLE(3, 0, 2, 1)));
+}
+#endif
+
+inline vec3_t<double> unit_vector(vec3_t<double> v)
+{
+	__m256d m = vec3_load(v);
+	return vec3_store(_mm256_div_pd(m, _mm256_set1_pd(sqrt(dot(v, v)))));
+}
+#endif
+#endif
+
+// Warps of uniform numbers in [0, 1) straight onto the shapes, one number per dimension
+// and no rejection, so a well spread set of samples stays well spread on the shape.
+
+// Uniform on the unit sphere: z uniform in [-1, 1] (Archimedes), phi around the z axis.
+inline vec3 sample_unit_vector(double u1, double u2)
+{
+	auto z = 1 - 2 * u1;
+	auto r = sqrt(fmax(0.0, 1 - z * z));
+	auto phi = 2 * pi * u2;
+	return vec3(r * cos(phi), r * sin(phi), z);
+}
+
+// Uniform in the unit ball: a direction, at a radius whose cube is uniform.
+inline vec3 sample_in_unit_sphere(double u1, double u2, double u3)
+{
+	return cbrt(u3) * sample_unit_vector(u1, u2);
+}
+
+// Uniform in the unit disk in the z = 0 plane, by Shirley and Chiu's concentric map, which
+// keeps neighbouring points of the square neighbours on the disk.
+inline vec3 sample_in_unit_disk(double u1, double u2)
+{
+	auto a = 2 * u1 - 1;
+	auto b = 2 * u2 - 1;
+	if (a == 0 && b == 0)
+		return vec3(0, 0, 0);
+
+	double r, theta;
+	if (fabs(a) > fabs(b))
 	{
-		auto p = vec3::random(-1, 1);
-		if (p.length_squared() >= 1) continue;
-		return p;
+		r = a;
+		theta = pi / 4 * (b / a);
 	}
+	else
+	{
+		r = b;
+		theta = pi / 2 - pi / 4 * (a / b);
+	}
+	return vec3(r * cos(theta), r * sin(theta), 0);
+}
+
+inline vec3 random_in_unit_sphere()
+{
+	auto u1 = random_double();
+	auto u2 = random_double();
+	return sample_in_unit_sphere(u1, u2, random_double());
 }
 
 inline vec3 random_unit_vector()
 {
-	return unit_vector(random_in_unit_sphere());
+	auto u1 = random_double();
+	return sample_unit_vector(u1, random_double());
 }
 
 inline vec3 random_in_hemisphere(const vec3& normal)
@@ -156,12 +303,8 @@ inline vec3 random_in_hemisphere(const vec3& normal)
 
 inline vec3 random_in_unit_disk()
 {
-	while (true)
-	{
-		auto p = vec3(random_double(-1, 1), random_double(-1, 1), 0);
-		if (p.length_squared() >= 1) continue;
-		return p;
-	}
+	auto u1 = random_double();
+	return sample_in_unit_disk(u1, random_double());
 }
 
 inline vec3 reflect(const vec3& v, const vec3 n)
@@ -169,7 +312,7 @@ inline vec3 reflect(const vec3& v, const vec3 n)
 	return v - 2 * dot(n, v) * n;
 }
 
-inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat)
+inline vec3 refract(const vec3& uv, const vec3& n, real etai_over_etat)
 {
 	auto cos_theta = fmin(dot(-uv, n), 1.0);
 	vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n);
@@ -0,0 +1,311 @@
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "linear_bvh.h"
+#include "light_list.h"
+#include "integrator.h"
+#include "adaptive_sampler.h"
+#include "sampler.h"
+#include "scenes.h"
+#include "render.h"
+#include "thread_pool.h"
+#include "simd.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// Renders the built-in scenes one after another at a fixed size, sample count, seed and
+// thread count, and reports per scene how long the scene and its BVH took to build, how
+// long the render took and how many rays it traced, as JSON. Meant for tracking
+// regressions and comparing machines, so nothing is written but the report.
+
+// The scene BVH with a count of the rays traced through it: camera rays, bounces and
+// shadow rays alike. Each thread counts in its own cache line.
+class counting_world : public hittable
+{
+public:
+	explicit counting_world(shared_ptr<hittable> scene) : scene(scene), counts(max_slots) {}
+
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override
+	{
+		counts[slot() % max_slots].rays.fetch_add(1, std::memory_order_relaxed);
+		return scene->hit(r, t_min, t_max, rec);
+	}
+
+	virtual bool bounding_box(real time0, real time1, aabb& output_box) const override
+	{
+		return scene->bounding_box(time0, time1, output_box);
+	}
+
+	uint64_t rays() const
+	{
+		uint64_t total = 0;
+		for (const auto& c : counts)
+			total += c.rays.load(std::memory_order_relaxed);
+		return total;
+	}
+
+private:
+	static const int max_slots = 256;
+
+	struct alignas(64) slot_count
+	{
+		std::atomic<uint64_t> rays{ 0 };
+	};
+
+	static int slot()
+	{
+		static std::atomic<int> next(0);
+		thread_local int index = next++;
+		return index;
+	}
+
+	shared_ptr<hittable> scene;
+	mutable std::vector<slot_count> counts;
+};
+
+// Most memory the process has held so far, in bytes.
+size_t peak_rss()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return static_cast<size_t>(usage.ru_maxrss);
+#else
+	return static_cast<size_t>(usage.ru_maxrss) * 1024;	// kilobytes on Linux
+#endif
+#endif
+}
+
+struct benchmark_result
+{
+	std::string name;
+	int width, height, spp;
+	double scene_ms;		// making the objects, including the BVHs inside them
+	double bvh_ms;			// the scene BVH over them
+	double render_ms;
+	uint64_t rays;
+	size_t peak_rss;		// of the process after this scene, so it never decreases
+};
+
+benchmark_result run_scene(int id, int width, int spp, uint64_t seed, sampler_type sampler_kind, thread_pool* pool, int tile_size,
+						   bool packets, const bvh_build_options& bvh_options, const integrator_settings& integrator)
+{
+	benchmark_result result;
+	result.name = scene_names[id];
+
+	// The same steps main() takes, without the progress output and the image.
+	seed_random(seed);
+	auto scene_start = std::chrono::steady_clock::now();
+	scene_assets assets;
+	auto scene = make_scene(id, assets, bvh_options);
+	light_list lights(scene.world, assets.materials);
+	result.scene_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - scene_start).count();
+
+	auto scene_bvh = make_shared<linear_bvh>(scene.world, 0.0, 1.0, bvh_options);
+	result.bvh_ms = scene_bvh->stats.build_ms;
+	counting_world world(scene_bvh);
+
+	result.width = width;
+	result.height = static_cast<int>(width / scene.aspect_ratio);
+	result.spp = spp;
+	camera cam(scene.lookfrom, scene.lookat, vec3(0, 1, 0), scene.vfov, scene.aspect_ratio, scene.aperture, 10.0, 0.0, 1.0);
+
+	auto render_start = std::chrono::steady_clock::now();
+	auto tiles = make_tiles(result.width, result.height, tile_size);
+	sample_accumulator samples(result.width, result.height);
+	adaptive_sampler sampler(adaptive_settings(), samples, spp);
+	auto source = make_sampler(sampler_kind, seed, spp, sampler.max_spp(), result.width);
+	while (sampler.next_pass(samples))
+	{
+		auto run_tile = [&](const tile& t) {
+			if (packets)
+				render_tile_packets(t, cam, scene.background, world, assets, lights, *scene_bvh, result.width, result.height, integrator, seed, source.get(), samples);
+			else
+				render_tile(t, cam, scene.background, world, assets, lights, result.width, result.height, integrator, seed, source.get(), samples);
+		};
+
+		if (!pool)
+		{
+			for (const auto& t : tiles)
+				run_tile(t);
+		}
+		else
+		{
+			for (const auto& t : tiles)
+				pool->submit([&run_tile, t] { run_tile(t); });
+			pool->wait();
+		}
+	}
+	result.render_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - render_start).count();
+
+	// Packets send their camera rays straight to the scene BVH, past the count.
+	result.rays = world.rays() + (packets ? static_cast<uint64_t>(result.width) * result.height * spp : 0);
+	result.peak_rss = peak_rss();
+	return result;
+}
+
+void write_json(std::ostream& out, const std::vector<benchmark_result>& results, uint64_t seed, sampler_type sampler_kind,
+				int threads, int tile_size, bool packets)
+{
+	out << "{\n"
+		<< "  \"seed\": " << seed << ",\n"
+		<< "  \"sampler\": \"" << sampler_type_names[static_cast<int>(sampler_kind)] << "\",\n"
+		<< "  \"threads\": " << threads << ",\n"
+		<< "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+		<< "  \"tile_size\": " << tile_size << ",\n"
+		<< "  \"packets\": " << (packets ? "true" : "false") << ",\n"
+		<< "  \"real\": \"" << (sizeof(real) == sizeof(float) ? "float" : "double") << "\",\n"
+		<< "  \"packet_width\": " << packet_width << ",\n"
+		<< "  \"scenes\": [";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const auto& r = results[i];
+		auto seconds = r.render_ms / 1000;
+		out << (i ? "," : "") << "\n    {\n"
+			<< "      \"name\": \"" << r.name << "\",\n"
+			<< "      \"width\": " << r.width << ",\n"
+			<< "      \"height\": " << r.height << ",\n"
+			<< "      \"spp\": " << r.spp << ",\n"
+			<< "      \"scene_build_ms\": " << r.scene_ms << ",\n"
+			<< "      \"bvh_build_ms\": " << r.bvh_ms << ",\n"
+			<< "      \"render_ms\": " << r.render_ms << ",\n"
+			<< "      \"rays\": " << r.rays << ",\n"
+			<< "      \"rays_per_second\": " << (seconds > 0 ? r.rays / seconds : 0) << ",\n"
+			<< "      \"samples_per_second\": " << (seconds > 0 ? static_cast<double>(r.width) * r.height * r.spp / seconds : 0) << ",\n"
+			<< "      \"peak_rss_bytes\": " << r.peak_rss << "\n"
+			<< "    }";
+	}
+	out << "\n  ]\n}\n";
+}
+
+int main(int argc, char* argv[])
+{
+	// Benchmark settings, overridable from the command line:
+	//   --scenes A,B,...      scenes to render, by name or number; by default every scene but
+	//                         earth, which needs its image file
+	//   --width N             image width in pixels; the height follows from each scene's aspect ratio
+	//   --spp N               samples per pixel
+	//   --seed N              seed for the scenes and the per-sample random streams
+	//   --sampler S           independent, stratified, sobol or blue-noise (see sampler.h)
+	//   --threads N           worker threads, 0 = one per hardware thread, 1 = render on the main thread
+	//   --tile-size N         edge length in pixels of the square tiles handed to the workers
+	//   --packets             trace camera rays as SIMD packets
+	//   --output FILE         write the report to FILE instead of stdout
+	std::string scene_list = "random_scene,two_spheres,two_perlin_spheres,simple_light,cornell_box,cornell_smoke,final_scene";
+	int width = 256;
+	int spp = 16;
+	uint64_t seed = 0;
+	sampler_type sampler_kind = sampler_type::independent;
+	int num_threads = 1;
+	int tile_size = 16;
+	bool packets = false;
+	std::string output;
+
+	for (int a = 1; a < argc; a++)
+	{
+		if (!strcmp(argv[a], "--scenes") && a + 1 < argc)
+			scene_list = argv[++a];
+		else if (!strcmp(argv[a], "--width") && a + 1 < argc)
+			width = atoi(argv[++a]);
+		else if (!strcmp(argv[a], "--spp") && a + 1 < argc)
+			spp = atoi(argv[++a]);
+		else if (!strcmp(argv[a], "--seed") && a + 1 < argc)
+			seed = strtoull(argv[++a], nullptr, 10);
+		else if (!strcmp(argv[a], "--sampler") && a + 1 < argc && parse_sampler_type(argv[a + 1], sampler_kind))
+			a++;
+		else if (!strcmp(argv[a], "--threads") && a + 1 < argc)
+			num_threads = atoi(argv[++a]);
+		else if (!strcmp(argv[a], "--tile-size") && a + 1 < argc)
+			tile_size = atoi(argv[++a]);
+		else if (!strcmp(argv[a], "--packets"))
+			packets = true;
+		else if (!strcmp(argv[a], "--output") && a + 1 < argc)
+			output = argv[++a];
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [--scenes A,B,...] [--width N] [--spp N] [--seed N]"
+					  << " [--sampler S] [--threads N] [--tile-size N] [--packets] [--output FILE]\n";
+			return 1;
+		}
+	}
+
+	std::vector<int> scenes;
+	std::stringstream names(scene_list);
+	std::string name;
+	while (std::getline(names, name, ','))
+	{
+		auto id = find_scene(name);
+		if (!id)
+		{
+			std::cerr << "Unknown scene '" << name << "'.\n";
+			return 1;
+		}
+		scenes.push_back(id);
+	}
+	if (width < 1 || spp < 1)
+	{
+		std::cerr << "--width and --spp must be at least 1.\n";
+		return 1;
+	}
+	if (tile_size < 1)
+		tile_size = 1;
+
+	std::unique_ptr<thread_pool> pool;
+	if (num_threads != 1)
+		pool.reset(new thread_pool(num_threads));
+	int threads = pool ? pool->size() : 1;
+
+	bvh_build_options bvh_options;
+	integrator_settings integrator;
+	std::vector<benchmark_result> results;
+	for (auto id : scenes)
+	{
+		std::cerr << scene_names[id] << "...\n";
+		results.push_back(run_scene(id, width, spp, seed, sampler_kind, pool.get(), tile_size, packets, bvh_options, integrator));
+	}
+
+	if (output.empty())
+	{
+		write_json(std::cout, results, seed, sampler_kind, threads, tile_size, packets);
+		return std::cout ? 0 : 1;
+	}
+
+	std::ofstream file(output);
+	write_json(file, results, seed, sampler_kind, threads, tile_size, packets);
+	if (!file)
+	{
+		std::cerr << "ERROR: Could not write the report to '" << output << "'.\n";
+		return 1;
+	}
+	return 0;
+}
\ No newline at end of file
@@ -3,376 +3,442 @@
 #include "camera.h"
 #include "color.h"
 #include "hittable_list.h"
-#include "sphere.h"
 #include "material.h"
-#include "moving_sphere.h"
-#include "aarect.h"
-#include "box.h"
-#include "constant_medium.h"
 #include "bvh.h"
-
+#include "linear_bvh.h"
+#include "integrator.h"
+#include "adaptive_sampler.h"
+#include "sampler.h"
+#include "checkpoint.h"
+#include "scenes.h"
+#include "render.h"
+#include "thread_pool.h"
+#include "framebuffer.h"
+#include "image_writer.h"
+#include "distributed.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
-color ray_color(const ray& r, const color& background, const hittable& world, int depth)
-{
-    hit_record rec;
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
-    // If we've exceeded the ray bounce limit, no more light is gathered.
-    if (depth <= 0)
-        return color(0,0,0);
+// Build settings for every BVH in the scene, see --leaf-size and --traversal-cost.
+bvh_build_options bvh_options;
 
-	if (!world.hit(r, 0.001, infinity, rec))
+int main(int argc, char* argv[])
+{
+	// Render settings, overridable from the command line:
+	//   --scene S             built-in scene by name or number (see scene_names), final_scene
+	//                         by default
+	//   --width N             image width in pixels, overriding the scene's; the height follows
+	//                         from its aspect ratio
+	//   --threads N           worker threads, 0 = one per hardware thread, 1 = render on the main thread
+	//   --tile-size N         edge length in pixels of the square tiles handed to the workers
+	//   --seed N              seed for the scene and for the per-sample random streams
+	//   --sampler S           independent, stratified, sobol or blue-noise (see sampler.h)
+	//   --leaf-size N         most primitives the BVH builder may put in one leaf
+	//   --traversal-cost X    cost of a BVH node visit relative to a primitive test
+	//   --max-depth N         most hits along one path
+	//   --rr-depth N          bounces before Russian roulette starts, -1 disables it
+	//   --max-bounces T N     most bounces of type T (diffuse, glossy, transmission, volume)
+	//   --no-light-sampling   find lights only by scattered rays, without shadow rays to them
+	//   --packets             trace camera rays of neighbouring pixels as SIMD packets
+	//   --virtual-dispatch    keep BVH primitives behind hittable pointers instead of by type
+	//   --static-bvh          bound moving primitives over the whole shutter instead of
+	//                         interpolating the BVH at each ray's time
+	//   --adaptive X          stop sampling a pixel once its relative error is below X, and spend
+	//                         the samples saved on noisier pixels
+	//   --min-spp N           samples every pixel takes with --adaptive
+	//   --max-spp N           most samples of one pixel with --adaptive
+	//   --spp-output FILE     also write the samples taken per pixel, max-spp = white
+	//   --spp N               samples per pixel, overriding the scene's
+	//   --heatmap FILE        also write the traversal work per pixel in false colour; needs a
+	//                         build with RT_STATS, which prints its counters at the end too
+	//   --checkpoint FILE     save the accumulated samples to FILE every checkpoint interval
+	//                         and when the render finishes
+	//   --checkpoint-interval S  seconds between checkpoints
+	//   --resume FILE         start from the samples in checkpoint FILE, for example to take a
+	//                         finished render to a higher --spp; keeps checkpointing to FILE
+	//   --output FILE         write the image to FILE instead of stdout
+	//   --format F            p3, p6, png, pfm, exr or exr-rle; by default taken from the
+	//                         output file extension, or p6 when writing to stdout
+	//   --coordinator A       hand the tiles out to worker processes connecting to address A
+	//                         (HOST:PORT, or unix:PATH) and write the image they render; see
+	//                         distributed.h
+	//   --workers N           with --coordinator, also start N workers on this machine, each
+	//                         with --threads threads
+	//   --worker-timeout S    seconds a worker with tiles may stay silent before they go to
+	//                         the others, 0 = wait for it as long as it stays connected
+	//   --worker A            render tiles for the coordinator at address A, with the same
+	//                         scene and settings, instead of an image
+	int scene_id = find_scene("final_scene");
+	int width = 0;
+	int num_threads = 0;
+	int tile_size = 16;
+	uint64_t seed = 0;
+	sampler_type sampler_kind = sampler_type::independent;
+	integrator_settings integrator;
+	bool packets = false;
+	adaptive_settings adaptive;
+	std::string output;
+	std::string spp_output;
+	std::string heatmap;
+	int spp = 0;
+	std::string checkpoint;
+	double checkpoint_interval = 600;
+	std::string resume;
+	std::string format;
+	std::string coordinator_address;
+	int local_workers = 0;
+	double worker_timeout = 0;
+	std::string worker_address;
+
+	bounce_type type;
+	for (int a = 1; a < argc; a++)
 	{
-		//vec3 unit_direction = unit_vector(r.direction());
-		//auto t = 0.5 * (unit_direction.y() + 1.0);
-		//return (1.0 - t) * color(1.0, 1.0, 1.0) + t * color(0.5, 0.7, 1.0);
-		return background;
+		if (!strcmp(argv[a], "--scene") && a + 1 < argc && (scene_id = find_scene(argv[a + 1])))
+			a++;
+		else if (!strcmp(argv[a], "--width") && a + 1 < argc)
+			width = atoi(argv[++a]);
+		else if (!strcmp(argv[a], "--threads") && a + 1 < argc)
+			num_threads = atoi(argv[++a]);
+		else if (!strcmp(argv[a], "--tile-size") && a + 1 < argc)
+			tile_size = atoi(argv[++a]);
+		else if (!strcmp(argv[a], "--seed") && a + 1 < argc)
+			seed = strtoull(argv[++a], nullptr, 10);
+		else if (!strcmp(argv[a], "--sampler") && a + 1 < argc && parse_sampler_type(argv[a + 1], sampler_kind))
+			a++;
+		else if (!strcmp(argv[a], "--leaf-size") && a + 1 < argc)
+			bvh_options.max_leaf_size = atoi(argv[++a]);
+		else if (!strcmp(argv[a], "--traversal-cost") && a + 1 < argc)
+			bvh_options.traversal_cost = atof(argv[++a]);
+		else if (!strcmp(argv[a], "--max-depth") && a + 1 < argc)
+			integrator.max_depth = atoi(argv[++a]);
+		else if (!strcmp(argv[a], "--rr-depth") && a + 1 < argc)
+			integrator.rr_start_depth = atoi(argv[++a]);
+		else if (!strcmp(argv[a], "--max-bounces") && a + 2 < argc && integrator_settings::parse_bounce_type(argv[a + 1], type))
+		{
+			integrator.limit(type) = atoi(argv[a + 2]);
+			a += 2;
+		}
+		else if (!strcmp(argv[a], "--no-light-sampling"))
+			integrator.sample_lights = false;
+		else if (!strcmp(argv[a], "--packets"))
+			packets = true;
+		else if (!strcmp(argv[a], "--virtual-dispatch"))
+			bvh_options.devirtualize = false;
+		else if (!strcmp(argv[a], "--static-bvh"))
+			bvh_options.motion = false;
+		else if (!strcmp(argv[a], "--adaptive") && a + 1 < argc)
+			adaptive.threshold = atof(argv[++a]);
+		else if (!strcmp(argv[a], "--min-spp") && a + 1 < argc)
+			adaptive.min_spp = atoi(argv[++a]);
+		else if (!strcmp(argv[a], "--max-spp") && a + 1 < argc)
+			adaptive.max_spp = atoi(argv[++a]);
+		else if (!strcmp(argv[a], "--spp-output") && a + 1 < argc)
+			spp_output = argv[++a];
+		else if (!strcmp(argv[a], "--spp") && a + 1 < argc)
+			spp = atoi(argv[++a]);
+		else if (!strcmp(argv[a], "--heatmap") && a + 1 < argc)
+			heatmap = argv[++a];
+		else if (!strcmp(argv[a], "--checkpoint") && a + 1 < argc)
+			checkpoint = argv[++a];
+		else if (!strcmp(argv[a], "--checkpoint-interval") && a + 1 < argc)
+			checkpoint_interval = atof(argv[++a]);
+		else if (!strcmp(argv[a], "--resume") && a + 1 < argc)
+			resume = argv[++a];
+		else if (!strcmp(argv[a], "--output") && a + 1 < argc)
+			output = argv[++a];
+		else if (!strcmp(argv[a], "--format") && a + 1 < argc)
+			format = argv[++a];
+		else if (!strcmp(argv[a], "--coordinator") && a + 1 < argc)
+			coordinator_address = argv[++a];
+		else if (!strcmp(argv[a], "--workers") && a + 1 < argc)
+			local_workers = atoi(argv[++a]);
+		else if (!strcmp(argv[a], "--worker-timeout") && a + 1 < argc)
+			worker_timeout = atof(argv[++a]);
+		else if (!strcmp(argv[a], "--worker") && a + 1 < argc)
+			worker_address = argv[++a];
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [--scene S] [--width N] [--threads N] [--tile-size N] [--seed N] [--sampler S]"
+					  << " [--leaf-size N] [--traversal-cost X] [--max-depth N] [--rr-depth N]"
+					  << " [--max-bounces T N] [--no-light-sampling] [--packets] [--virtual-dispatch] [--static-bvh]"
+					  << " [--adaptive X] [--min-spp N] [--max-spp N] [--spp-output FILE]"
+					  << " [--spp N] [--heatmap FILE] [--checkpoint FILE] [--checkpoint-interval S] [--resume FILE] [--output FILE] [--format F]"
+					  << " [--coordinator A] [--workers N] [--worker-timeout S] [--worker A]\n";
+			return 1;
+		}
 	}
 
-	ray scattered;
-	color attenuation;
-	color emitted = rec.mat_ptr->emitted(rec.u, rec.v, rec.p);
-
-	if (!rec.mat_ptr->scatter(r, rec, attenuation, scattered))
-		return emitted;
-
-	return emitted + attenuation * ray_color(scattered, background, world, depth - 1);
-}
-
-hittable_list random_scene()
-{
-	hittable_list world;
-	//auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
-	//world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
-	auto checker = make_shared<checker_texture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
-	world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(checker)));
+	if (!coordinator_address.empty() && !worker_address.empty())
+	{
+		std::cerr << "--coordinator and --worker exclude each other.\n";
+		return 1;
+	}
+	if (local_workers > 0 && coordinator_address.empty())
+	{
+		std::cerr << "--workers needs --coordinator.\n";
+		return 1;
+	}
+	if (!coordinator_address.empty() && !heatmap.empty())
+	{
+		std::cerr << "--heatmap is not available with --coordinator: the work is counted by the workers.\n";
+		return 1;
+	}
+	if (!worker_address.empty())
+	{
+		// A worker writes nothing; local workers are started with the coordinator's options.
+		spp_output.clear();
+		heatmap.clear();
+		checkpoint.clear();
+		resume.clear();
+	}
 
-	for (int a = -11; a < 11; a++)
+	if (format.empty())
+		format = output.empty() ? "p6" : format_from_filename(output);
+	auto writer = make_image_writer(format);
+	if (!writer)
+	{
+		std::cerr << "Unknown image format '" << format << "'.\n";
+		return 1;
+	}
+	shared_ptr<image_writer> spp_writer;
+	if (!spp_output.empty() && !(spp_writer = make_image_writer(format_from_filename(spp_output))))
+	{
+		std::cerr << "Unknown image format for '" << spp_output << "'.\n";
+		return 1;
+	}
+	shared_ptr<image_writer> heatmap_writer;
+	if (!heatmap.empty())
 	{
-		for (int b = -11; b < 11; b++)
+#if defined(RT_STATS)
+		if (!(heatmap_writer = make_image_writer(format_from_filename(heatmap))))
 		{
-			auto choose_mat = random_double();
-			point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
-
-			if ((center - point3(4, 0.2, 0)).length() > 0.9)
-			{
-				shared_ptr<material> sphere_material;
-
-				if (choose_mat < 0.8)
-				{
-					// diffuse
-					auto albedo = color::random() * color::random();
-					sphere_material = make_shared<lambertian>(albedo);
-					auto center2 = center + vec3(0, random_double(0, .5), 0);
-					world.add(make_shared<moving_sphere>(center, center2, 0.0, 1.0, 0.2, sphere_material));
-				}
-				else if (choose_mat < 0.95)
-				{
-					// metal
-					auto albedo = color::random(0.5, 1);
-					auto fuzz = random_double(0, 0.5);
-					sphere_material = make_shared<metal>(albedo, fuzz);
-					world.add(make_shared<sphere>(center, 0.2, sphere_material));
-				}
-				else
-				{
-					// glass
-					sphere_material = make_shared<dielectric>(1.5);
-					world.add(make_shared<sphere>(center, 0.2, sphere_material));
-				}
-			}
+			std::cerr << "Unknown image format for '" << heatmap << "'.\n";
+			return 1;
 		}
+#else
+		std::cerr << "--heatmap needs a build with RT_STATS defined.\n";
+		return 1;
+#endif
 	}
+	if (tile_size < 1)
+		tile_size = 1;
 
-	auto material1 = make_shared<dielectric>(1.5);
-	world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+	seed_random(seed);
 
-	auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-	world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
-
-	auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
-	world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
-
-	return world;
-}
-
-hittable_list two_spheres() {
-	hittable_list objects;
-
-	auto checker = make_shared<checker_texture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
-
-	objects.add(make_shared<sphere>(point3(0, -10, 0), 10, make_shared<lambertian>(checker)));
-	objects.add(make_shared<sphere>(point3(0, 10, 0), 10, make_shared<lambertian>(checker)));
-
-	return objects;
-}
-
-hittable_list two_perlin_spheres()
-{
-	hittable_list objects;
-
-	auto pertext = make_shared<noise_texture>(4);
-	objects.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(pertext)));
-	objects.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<lambertian>(pertext)));
-	
-	return objects;
-}
-
-hittable_list earth()
-{
-	auto earth_texture = make_shared<image_texture>("E://Study//Computer_Graphics//RayTracing//Ray-Tracing//RayTracingTheNextWeek//RayTracing//earthmap.jpg");
-	auto earth_surface = make_shared<lambertian>(earth_texture);
-	auto globe = make_shared<sphere>(point3(0, 0, 0), 2, earth_surface);
-	return hittable_list(globe);
-}
-
-hittable_list simple_light()
-{
-	hittable_list objects;
-
-	auto pertext = make_shared<noise_texture>(4);
-	objects.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(pertext)));
-	objects.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<lambertian>(pertext)));
-
-	auto difflight = make_shared<diffuse_light>(color(4, 4, 4));
-	objects.add(make_shared<xy_rect>(3, 5, 1, 3, -2, difflight));
-	objects.add(make_shared<sphere>(point3(0, 7, 0), 2, make_shared<diffuse_light>(color(4, 4, 4))));
-
-	return objects;
-}
-
-hittable_list cornell_box()
-{
-	hittable_list objects;
-
-	auto red = make_shared<lambertian>(color(.65, .05, .05));
-	auto white = make_shared<lambertian>(color(.73, .73, .73));
-	auto green = make_shared<lambertian>(color(.12, .45, .15));
-	auto light = make_shared<diffuse_light>(color(15, 15, 15));
-
-	objects.add(make_shared<yz_rect>(0, 555, 0, 555, 555, green));
-	objects.add(make_shared<yz_rect>(0, 555, 0, 555, 0, red));
-	objects.add(make_shared<xz_rect>(213, 343, 227, 332, 554, light));
-	objects.add(make_shared<xz_rect>(0, 555, 0, 555, 0, white));
-	objects.add(make_shared<xz_rect>(0, 555, 0, 555, 555, white));
-	objects.add(make_shared<xy_rect>(0, 555, 0, 555, 555, white));
-
-	//objects.add(make_shared<box>(point3(130, 0, 65), point3(295, 165, 230), white));
-	//objects.add(make_shared<box>(point3(265, 0, 295), point3(430, 330, 460), white));
-	shared_ptr<hittable> box1 = make_shared<box>(point3(0, 0, 0), point3(165, 330, 165), white);
-	box1 = make_shared<rotate_y>(box1, 15);
-	box1 = make_shared<translate>(box1, vec3(265, 0, 295));
-	objects.add(box1);
-
-	shared_ptr<hittable> box2 = make_shared<box>(point3(0, 0, 0), point3(165, 165, 165), white);
-	box2 = make_shared<rotate_y>(box2, -18);
-	box2 = make_shared<translate>(box2, vec3(130, 0, 65));
-	objects.add(box2);
-
-	return objects;
-}
-
-hittable_list cornell_smoke()
-{
-	hittable_list objects;
-
-	auto red = make_shared<lambertian>(color(.65, .05, .05));
-	auto white = make_shared<lambertian>(color(.73, .73, .73));
-	auto green = make_shared<lambertian>(color(.12, .45, .15));
-	auto light = make_shared<diffuse_light>(color(7, 7, 7));
-
-	objects.add(make_shared<yz_rect>(0, 555, 0, 555, 555, green));
-	objects.add(make_shared<yz_rect>(0, 555, 0, 555, 0, red));
-	objects.add(make_shared<xz_rect>(113, 443, 127, 432, 554, light));
-	objects.add(make_shared<xz_rect>(0, 555, 0, 555, 555, white));
-	objects.add(make_shared<xz_rect>(0, 555, 0, 555, 0, white));
-	objects.add(make_shared<xy_rect>(0, 555, 0, 555, 555, white));
+	// World
+	scene_assets assets;	// materials and textures the world refers to by id
+	auto scene = make_scene(scene_id, assets, bvh_options);
+	auto world = scene.world;
+	auto background = scene.background;
 
-	shared_ptr<hittable> box1 = make_shared<box>(point3(0, 0, 0), point3(165, 330, 165), white);
-	box1 = make_shared<rotate_y>(box1, 15);
-	box1 = make_shared<translate>(box1, vec3(265, 0, 295));
+	// image
+	auto aspect_ratio = scene.aspect_ratio;
+	int image_width = width > 0 ? width : scene.image_width;
+	int samples_per_pixel = spp > 0 ? spp : scene.samples_per_pixel;
 
-	shared_ptr<hittable> box2 = make_shared<box>(point3(0, 0, 0), point3(165, 165, 165), white);
-	box2 = make_shared<rotate_y>(box2, -18);
-	box2 = make_shared<translate>(box2, vec3(130, 0, 65));
+	// The emitters the integrator sends shadow rays to.
+	light_list lights(world, assets.materials);
 
-	objects.add(make_shared<constant_medium>(box1, 0.01, color(0, 0, 0)));
-	objects.add(make_shared<constant_medium>(box2, 0.01, color(1, 1, 1)));
+	// Put the whole scene under one flattened BVH instead of testing every object in turn.
+	auto scene_bvh = make_shared<linear_bvh>(world, 0.0, 1.0, bvh_options);
+	scene_bvh->stats.report(std::cerr, "Scene BVH");
+	world = hittable_list(scene_bvh);
 
-	return objects;
-}
+	// Camera
+	vec3 vup(0, 1, 0);
+	auto dist_to_focus = 10.0;
+	int image_height = static_cast<int>(image_width / aspect_ratio);
 
-hittable_list final_scene()
-{
-	hittable_list boxes1;
-	auto ground = make_shared<lambertian>(color(0.48, 0.83, 0.53));
+	camera cam(scene.lookfrom, scene.lookat, vup, scene.vfov, aspect_ratio, scene.aperture, dist_to_focus, 0.0, 1.0);
 
-	const int boxes_per_side = 20;
-	for (int i = 0; i < boxes_per_side; i++)
+	// render
+	std::unique_ptr<thread_pool> pool;
+	if (num_threads != 1)
+		pool.reset(new thread_pool(num_threads));
+
+	auto tiles = make_tiles(image_width, image_height, tile_size);
+
+	// What the samples depend on, for checkpoints and workers to match.
+	render_job job;
+	job.seed = seed;
+	job.scene_id = scene_id;
+	job.width = image_width;
+	job.height = image_height;
+	job.samples_per_pixel = samples_per_pixel;
+	job.sampler = static_cast<int32_t>(sampler_kind);
+	job.max_depth = integrator.max_depth;
+	job.rr_start_depth = integrator.rr_start_depth;
+	for (int i = 0; i < bounce_type_count; i++)
+		job.max_bounces[i] = integrator.max_bounces[i];
+	job.sample_lights = integrator.sample_lights;
+
+	sample_accumulator samples(image_width, image_height);
+	if (heatmap_writer)
+		render_stats_registry::get().reset_pixels(static_cast<size_t>(image_width) * image_height);
+	render_job saved;
+	if (!resume.empty())
 	{
-		for (int j = 0; j < boxes_per_side; j++)
+		if (!load_checkpoint(resume, samples, saved))
+			return 1;
+		if (auto setting = job.mismatch(saved))
 		{
-			auto w = 100.0;
-			auto x0 = -1000.0 + i * w;
-			auto z0 = -1000.0 + j * w;
-			auto y0 = 0.0;
-			auto x1 = x0 + w;
-			auto y1 = random_double(1, 101);
-			auto z1 = z0 + w;
-
-			boxes1.add(make_shared<box>(point3(x0, y0, z0), point3(x1, y1, z1), ground));
+			std::cerr << "Checkpoint '" << resume << "' was rendered with a different " << setting << ".\n";
+			return 1;
 		}
+		if (checkpoint.empty())
+			checkpoint = resume;
 	}
 
-	hittable_list objects;
-	objects.add(make_shared<bvh_node>(boxes1, 0, 1));
+	// Without --adaptive there is a single pass of samples_per_pixel, unless checkpoints need
+	// somewhere to happen: then passes are --min-spp samples long.
+	if (!checkpoint.empty())
+		adaptive.pass_spp = adaptive.min_spp;
+	adaptive_sampler sampler(adaptive, samples, samples_per_pixel);
+	job.max_spp = sampler.max_spp();
+	if (!resume.empty())
+	{
+		// The sampler's strata and sequences are laid out for the sample counts the render
+		// started with; taking it higher continues them.
+		job.samples_per_pixel = saved.samples_per_pixel;
+		job.max_spp = saved.max_spp;
+	}
+	auto source = make_sampler(sampler_kind, seed, job.samples_per_pixel, job.max_spp, image_width);
+	auto render_one = [&](const tile& t) {
+		if (packets)
+			render_tile_packets(t, cam, background, world, assets, lights, *scene_bvh, image_width, image_height, integrator, seed, source.get(), samples);
+		else
+			render_tile(t, cam, background, world, assets, lights, image_width, image_height, integrator, seed, source.get(), samples);
+	};
+
+	if (!worker_address.empty())
+	{
+		auto start = [&](const render_job& assigned) {
+			source = make_sampler(sampler_kind, seed, assigned.samples_per_pixel, assigned.max_spp, image_width);
+		};
+		return run_worker(worker_address, job, samples, pool.get(), start, render_one) ? 0 : 1;
+	}
 
-	auto light = make_shared<diffuse_light>(color(7, 7, 7));
-	objects.add(make_shared<xz_rect>(123, 423, 147, 412, 554, light));
+	std::unique_ptr<tile_coordinator> coordinator;
+	if (!coordinator_address.empty())
+	{
+		coordinator.reset(new tile_coordinator(job, worker_timeout));
+		if (!coordinator->listen(coordinator_address) || (local_workers > 0 && !coordinator->spawn_local_workers(local_workers, argc, argv)))
+			return 1;
+	}
 
+	auto last_checkpoint = std::chrono::steady_clock::now();
+	while (size_t pass_pixels = sampler.next_pass(samples))
+	{
+		if (sampler.adaptive() || !checkpoint.empty())
+			std::cerr << "\rPass " << sampler.pass_count() << ": " << pass_pixels << " pixels\n";
 
-	auto center1 = point3(400, 400, 200);
-	auto center2 = center1 + vec3(30, 0, 0);
-	auto moving_sphere_material = make_shared<lambertian>(color(0.7, 0.3, 0.1));
-	objects.add(make_shared<moving_sphere>(center1, center2, 0, 1, 50, moving_sphere_material));
+		std::atomic<int> tiles_remaining(static_cast<int>(tiles.size()));
+		std::mutex progress_mutex;
+		auto run_tile = [&](const tile& t) {
+			render_one(t);
 
-	objects.add(make_shared<sphere>(point3(260, 150, 45), 50, make_shared<dielectric>(1.5)));
-	objects.add(make_shared<sphere>(point3(0, 150, 145), 50, make_shared<metal>(color(0.8, 0.8, 0.9), 1.0)));
-	
-	auto boundary = make_shared<sphere>(point3(360, 150, 145), 70, make_shared<dielectric>(1.5));
-	objects.add(boundary);
-	objects.add(make_shared<constant_medium>(boundary, 0.2, color(0.2, 0.4, 0.9)));
-	boundary = make_shared<sphere>(point3(0, 0, 0), 5000, make_shared<dielectric>(1.5));
-	objects.add(make_shared<constant_medium>(boundary, .0001, color(1, 1, 1)));
+			auto remaining = --tiles_remaining;
+			std::lock_guard<std::mutex> lock(progress_mutex);
+			std::cerr << "\rTiles remaining: " << remaining << ' ' << std::flush;
+		};
 
-	auto emat = make_shared<lambertian>(make_shared<image_texture>("earthmap.jpg"));
-	objects.add(make_shared<sphere>(point3(400, 200, 400), 100, emat));
-	auto pertext = make_shared<noise_texture>(0.1);
-	objects.add(make_shared<sphere>(point3(220, 280, 300), 80, make_shared<lambertian>(pertext)));
+		if (coordinator)
+		{
+			if (!coordinator->render_pass(tiles, samples))
+				return 1;
+		}
+		else if (!pool)
+		{
+			for (const auto& t : tiles)
+				run_tile(t);
+		}
+		else
+		{
+			for (const auto& t : tiles)
+				pool->submit([&run_tile, t] { run_tile(t); });
+			pool->wait();
+		}
 
-	hittable_list boxes2;
-	auto white = make_shared<lambertian>(color(.73, .73, .73));
-	int ns = 1000;
-	for (int j = 0; j < ns; j++)
-	{
-		boxes2.add(make_shared<sphere>(point3::random(0, 165), 10, white));
+		auto now = std::chrono::steady_clock::now();
+		if (!checkpoint.empty() && std::chrono::duration<double>(now - last_checkpoint).count() >= checkpoint_interval)
+		{
+			if (!save_checkpoint(checkpoint, samples, job))
+				std::cerr << "\nERROR: Could not write the checkpoint '" << checkpoint << "'.\n";
+			last_checkpoint = now;
+		}
 	}
 
-	objects.add(make_shared<translate>(make_shared<rotate_y>(make_shared<bvh_node>(boxes2, 0.0, 1.0), 15), vec3(-100, 270, 395)));
-
-	return objects;
-}
-int main()
-{
-	// image
-	auto aspect_ratio = 16.0 / 9.0;
-	int image_width = 400;
-	int samples_per_pixel = 100;
-	const int max_depth = 50;
-
-	// World
-	hittable_list world;
-
-	point3 lookfrom;
-	point3 lookat;
-	auto vfov = 40.0;
-	auto aperture = 0.0;
-	color background(0, 0, 0);
-
-	switch (0) {
-	case 1:
-		world = random_scene();
-		background = color(0.70, 0.80, 1.00);
-		lookfrom = point3(13, 2, 3);
-		lookat = point3(0, 0, 0);
-		vfov = 20.0;
-		aperture = 0.1;
-		break;
-	case 2:
-		world = two_spheres();
-		background = color(0.70, 0.80, 1.00);
-		lookfrom = point3(13, 2, 3);
-		lookat = point3(0, 0, 0);
-		vfov = 20.0;
-		break;
-	case 3:
-		world = two_perlin_spheres();
-		background = color(0.70, 0.80, 1.00);
-		lookfrom = point3(13, 2, 3);
-		lookat = point3(0, 0, 0);
-		vfov = 20.0;
-		break;
-	case 4:
-		world = earth();
-		background = color(0.70, 0.80, 1.00);
-		lookfrom = point3(13, 2, 3);
-		lookat = point3(0, 0, 0);
-		vfov = 20.0;
-		break;
-	case 5:
-		world = simple_light();
-		samples_per_pixel = 400;
-		background = color(0.0, 0.0, 0.0);
-		lookfrom = point3(26, 3, 6);
-		lookat = point3(0, 2, 0);
-		vfov = 20.0;
-		break;
-	case 6:
-		world = cornell_box();
-		aspect_ratio = 1.0;
-		image_width = 600;
-		samples_per_pixel = 200;
-		background = color(0, 0, 0);
-		lookfrom = point3(278, 278, -800);
-		lookat = point3(278, 278, 0);
-		vfov = 40.0;
-		break;
-	case 7:
-		world = cornell_smoke();
-		aspect_ratio = 1.0;
-		image_width = 600;
-		samples_per_pixel = 200;
-		lookfrom = point3(278, 278, -800);
-		lookat = point3(278, 278, 0);
-		vfov = 40.0;
-		break;
-	default:
-	case 8:
-		world = final_scene();
-		aspect_ratio = 1.0;
-		image_width = 800;
-		samples_per_pixel = 10000;
-		lookfrom = point3(478, 278, -600);
-		lookat = point3(278, 278, 0);
-		vfov = 40.0;
-		break;
+	if (!checkpoint.empty() && !save_checkpoint(checkpoint, samples, job))
+	{
+		std::cerr << "\nERROR: Could not write the checkpoint '" << checkpoint << "'.\n";
+		return 1;
 	}
 
-	// Camera
-	vec3 vup(0, 1, 0);
-	auto dist_to_focus = 10.0;
-	int image_height = static_cast<int>(image_width / aspect_ratio);
+	framebuffer image(image_width, image_height);
+	for (int j = 0; j < image_height; ++j)
+		for (int i = 0; i < image_width; ++i)
+			image.set(i, j, samples.mean(static_cast<size_t>(j) * image_width + i));
 
-	camera cam(lookfrom, lookat, vup, vfov, aspect_ratio, aperture, dist_to_focus, 0.0, 1.0);
+	// output
+	bool written;
+	if (output.empty())
+	{
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		written = writer->write(std::cout, image, pool.get());
+		std::cout.flush();
+	}
+	else
+	{
+		std::ofstream file(output, std::ios::binary);
+		written = file && writer->write(file, image, pool.get());
+	}
+	if (!written)
+	{
+		std::cerr << "\nERROR: Could not write the image" << (output.empty() ? "" : " to '" + output + "'") << ".\n";
+		return 1;
+	}
 
-	// render
-	std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+	if (!spp_output.empty())
+	{
+		std::ofstream file(spp_output, std::ios::binary);
+		if (!file || !spp_writer->write(file, sampler.spp_image(samples, image_width, image_height), pool.get()))
+		{
+			std::cerr << "\nERROR: Could not write the sample counts to '" << spp_output << "'.\n";
+			return 1;
+		}
+	}
 
-	for (int j = image_height - 1; j >= 0; --j) 
+	if (heatmap_writer)
 	{
-		std::cerr << "\rScanlines remaining: " << j << ' ' << std::flush;
-		for (int i = 0; i < image_width; ++i) 
+		std::ofstream file(heatmap, std::ios::binary);
+		if (!file || !heatmap_writer->write(file, cost_heatmap(render_stats_registry::get().costs(), image_width, image_height), pool.get()))
 		{
-			color pixel_color(0, 0, 0);
-			for (int s = 0; s < samples_per_pixel; ++s) {
-				auto u = (i + random_double()) / (image_width - 1);
-				auto v = (j + random_double()) / (image_height - 1);
-				ray r = cam.get_ray(u, v);
-				pixel_color += ray_color(r, background, world, max_depth);
-			}
-			write_color(std::cout, pixel_color, samples_per_pixel);
+			std::cerr << "\nERROR: Could not write the heatmap to '" << heatmap << "'.\n";
+			return 1;
 		}
 	}
+
+#if defined(RT_STATS)
+	std::cerr << '\n';
+	report_render_stats(std::cerr);
+#endif
 	std::cerr << "\nDone.\n";
 	return 0;
 }
\ No newline at end of file
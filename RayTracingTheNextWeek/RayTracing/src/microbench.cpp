@@ -0,0 +1,215 @@
+#include "rtweekend.h"
+
+#include "aabb.h"
+#include "hittable_list.h"
+#include "sphere.h"
+#include "moving_sphere.h"
+#include "aarect.h"
+#include "box.h"
+#include "bvh.h"
+#include "linear_bvh.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Times the intersection kernels one at a time, each against the same reproducible ray sets,
+// and prints ns per test and the fraction of rays that hit. Every kernel's geometry lies in
+// [-1, 1]^3 and is called through its own class, without a virtual call in front of it.
+//
+//   coherent  camera rays from z = -5 through a 256 x 256 grid over [-1.5, 1.5]^2
+//   diffuse   bounces off a Lambertian wall around the geometry: from a sphere of radius 2,
+//             cosine distributed around its inward normal
+//   grazing   rays at most 1 degree off the z = 0 plane of the rect, from just above or below it
+
+struct ray_set
+{
+	const char* name;
+	std::vector<ray> rays;
+};
+
+ray_set coherent_rays()
+{
+	ray_set set{ "coherent", {} };
+	const int n = 256;
+	for (int j = 0; j < n; j++)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			point3 target(-1.5 + 3.0 * (i + 0.5) / n, -1.5 + 3.0 * (j + 0.5) / n, 0);
+			point3 origin(0, 0, -5);
+			set.rays.push_back(ray(origin, target - origin, random_double()));
+		}
+	}
+	return set;
+}
+
+ray_set diffuse_rays(size_t count)
+{
+	ray_set set{ "diffuse", {} };
+	for (size_t i = 0; i < count; i++)
+	{
+		auto normal = -random_unit_vector();
+		auto origin = -2 * normal;
+		auto direction = normal + random_unit_vector();
+		if (direction.near_zero())
+			direction = normal;
+		set.rays.push_back(ray(origin, direction, random_double()));
+	}
+	return set;
+}
+
+ray_set grazing_rays(size_t count)
+{
+	ray_set set{ "grazing", {} };
+	for (size_t i = 0; i < count; i++)
+	{
+		auto phi = 2 * pi * random_double();
+		auto tilt = degrees_to_radians(random_double(-1, 1));
+		point3 origin(random_double(-1, 1) - 2 * cos(phi), random_double(-1, 1) - 2 * sin(phi), random_double(-1e-3, 1e-3));
+		vec3 direction(cos(phi) * cos(tilt), sin(phi) * cos(tilt), sin(tilt));
+		set.rays.push_back(ray(origin, direction, random_double()));
+	}
+	return set;
+}
+
+struct kernel_result
+{
+	double ns_per_test;
+	double hit_rate;
+};
+
+// Runs test over the rays until at least min_ms have passed, after one untimed round that
+// warms the caches and counts the hits.
+template <typename Test>
+kernel_result measure(const std::vector<ray>& rays, double min_ms, Test test)
+{
+	size_t hits = 0;
+	for (const auto& r : rays)
+		hits += test(r);
+
+	size_t tests = 0;
+	size_t sink = 0;
+	auto start = std::chrono::steady_clock::now();
+	double elapsed_ms;
+	do
+	{
+		for (const auto& r : rays)
+			sink += test(r);
+		tests += rays.size();
+		elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	} while (elapsed_ms < min_ms);
+
+	// Keeps the timed calls from being optimised away.
+	volatile size_t keep = sink;
+	(void)keep;
+
+	return { elapsed_ms * 1e6 / tests, static_cast<double>(hits) / rays.size() };
+}
+
+int main(int argc, char* argv[])
+{
+	// Microbenchmark settings, overridable from the command line:
+	//   --rays N              rays in each incoherent set (the coherent set is always 256 x 256)
+	//   --min-ms X            least time spent timing each kernel on each set
+	//   --seed N              seed for the ray sets and the BVH's spheres
+	//   --filter S            only the kernels whose name contains S
+	size_t ray_count = 65536;
+	double min_ms = 200;
+	uint64_t seed = 0;
+	std::string filter;
+
+	for (int a = 1; a < argc; a++)
+	{
+		if (!strcmp(argv[a], "--rays") && a + 1 < argc)
+			ray_count = strtoull(argv[++a], nullptr, 10);
+		else if (!strcmp(argv[a], "--min-ms") && a + 1 < argc)
+			min_ms = atof(argv[++a]);
+		else if (!strcmp(argv[a], "--seed") && a + 1 < argc)
+			seed = strtoull(argv[++a], nullptr, 10);
+		else if (!strcmp(argv[a], "--filter") && a + 1 < argc)
+			filter = argv[++a];
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [--rays N] [--min-ms X] [--seed N] [--filter S]\n";
+			return 1;
+		}
+	}
+
+	seed_random(seed);
+	std::vector<ray_set> sets;
+	sets.push_back(coherent_rays());
+	sets.push_back(diffuse_rays(ray_count));
+	sets.push_back(grazing_rays(ray_count));
+
+	// The geometry under test.
+	const material_id mat = 0;
+	aabb unit_box(point3(-1, -1, -1), point3(1, 1, 1));
+	sphere unit_sphere(point3(0, 0, 0), 1, mat);
+	moving_sphere moving(point3(-0.5, 0, 0), point3(0.5, 0, 0), 0, 1, 1, mat);
+	xy_rect rect(-1, 1, -1, 1, 0, mat);
+	box solid_box(point3(-1, -1, -1), point3(1, 1, 1), mat);
+
+	// 1000 small spheres, under both BVH layouts.
+	hittable_list spheres;
+	for (int i = 0; i < 1000; i++)
+		spheres.add(make_shared<sphere>(point3::random(-0.95, 0.95), 0.05, mat));
+	bvh_node tree(spheres, 0, 1);
+	linear_bvh flat(spheres, 0, 1);
+
+	// The same spheres moving up to 0.2 along each axis over the shutter, under a BVH that
+	// interpolates its bounds at the ray's time and one over the whole shutter's boxes.
+	hittable_list movers;
+	for (const auto& object : spheres.objects)
+	{
+		auto center0 = static_cast<const sphere&>(*object).center;
+		auto center1 = center0 + vec3::random(-0.2, 0.2);
+		for (int a = 0; a < 3; a++)
+			center1[a] = clamp(center1[a], -0.95, 0.95);
+		movers.add(make_shared<moving_sphere>(center0, center1, 0, 1, 0.05, mat));
+	}
+	linear_bvh motion_flat(movers, 0, 1);
+	bvh_build_options shutter_options;
+	shutter_options.motion = false;
+	linear_bvh shutter_flat(movers, 0, 1, shutter_options);
+
+	const real t_min = 0.001;
+	const real t_max = infinity;
+	hit_record rec;
+
+	std::printf("%-24s %-9s %10s %9s\n", "kernel", "rays", "ns/test", "hit rate");
+	auto run = [&](const char* name, const ray_set& set, kernel_result result) {
+		std::printf("%-24s %-9s %10.2f %8.1f%%\n", name, set.name, result.ns_per_test, 100 * result.hit_rate);
+		std::fflush(stdout);
+	};
+	auto selected = [&](const char* name) { return filter.empty() || std::string(name).find(filter) != std::string::npos; };
+
+	for (const auto& set : sets)
+	{
+		const auto& rays = set.rays;
+		if (selected("aabb::hit"))
+			run("aabb::hit", set, measure(rays, min_ms, [&](const ray& r) { return unit_box.hit(r, t_min, t_max); }));
+		if (selected("sphere::hit"))
+			run("sphere::hit", set, measure(rays, min_ms, [&](const ray& r) { return unit_sphere.sphere::hit(r, t_min, t_max, rec); }));
+		if (selected("moving_sphere::hit"))
+			run("moving_sphere::hit", set, measure(rays, min_ms, [&](const ray& r) { return moving.moving_sphere::hit(r, t_min, t_max, rec); }));
+		if (selected("xy_rect::hit"))
+			run("xy_rect::hit", set, measure(rays, min_ms, [&](const ray& r) { return rect.xy_rect::hit(r, t_min, t_max, rec); }));
+		if (selected("box::hit"))
+			run("box::hit", set, measure(rays, min_ms, [&](const ray& r) { return solid_box.box::hit(r, t_min, t_max, rec); }));
+		if (selected("bvh_node::hit"))
+			run("bvh_node::hit", set, measure(rays, min_ms, [&](const ray& r) { return tree.bvh_node::hit(r, t_min, t_max, rec); }));
+		if (selected("linear_bvh::hit"))
+			run("linear_bvh::hit", set, measure(rays, min_ms, [&](const ray& r) { return flat.linear_bvh::hit(r, t_min, t_max, rec); }));
+		if (selected("linear_bvh::hit motion"))
+			run("linear_bvh::hit motion", set, measure(rays, min_ms, [&](const ray& r) { return motion_flat.linear_bvh::hit(r, t_min, t_max, rec); }));
+		if (selected("linear_bvh::hit shutter"))
+			run("linear_bvh::hit shutter", set, measure(rays, min_ms, [&](const ray& r) { return shutter_flat.linear_bvh::hit(r, t_min, t_max, rec); }));
+	}
+	return 0;
+}
\ No newline at end of file